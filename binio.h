@@ -0,0 +1,44 @@
+/*
+* reading and writing values as raw bytes, for the files countext keeps between runs
+* ('--cache', '--checkpoint'). they're only ever read back on the machine that wrote them,
+* so there's no byte order to worry about.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+namespace BinIO
+{
+    template<typename ValT>
+    static inline void writeVal(std::ostream& os, ValT val)
+    {
+        os.write(reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+
+    template<typename ValT>
+    static inline bool readVal(std::istream& is, ValT& val)
+    {
+        return bool(is.read(reinterpret_cast<char*>(&val), sizeof(val)));
+    }
+
+    static inline void writeString(std::ostream& os, const std::string& str)
+    {
+        writeVal(os, uint64_t(str.size()));
+        os.write(str.data(), str.size());
+    }
+
+    // anything longer than $maxlen is taken to be garbage
+    static inline bool readString(std::istream& is, std::string& str, uint64_t maxlen=(uint64_t(1) << 30))
+    {
+        uint64_t len;
+        if(!readVal(is, len) || (len > maxlen))
+        {
+            return false;
+        }
+        str.resize(len);
+        return bool(is.read(str.data(), len));
+    }
+}
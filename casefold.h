@@ -0,0 +1,451 @@
+
+/*
+* case folding for '--nocase'.
+* keys are nearly always plain ASCII (file extensions especially), so those are lowercased
+* in place, 16 (SSE2) or 8 (everywhere else) bytes at a time. anything containing multibyte
+* UTF-8 is decoded, and run through unicode simple case folding instead - which, unlike
+* ::tolower(), also knows that 'Ä' and 'ä' are the same.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define CFILES_HAVE_SSE2
+#endif
+
+namespace CaseFold
+{
+    struct FoldRange
+    {
+        // first and last codepoint that this range applies to
+        uint32_t first;
+        uint32_t last;
+        // what to add to a codepoint to get its folded form
+        int32_t delta;
+        // 1 if every codepoint in [first, last] is folded, 2 if only every other one is
+        // (i.e., upper/lower pairs like 'Ā', 'ā', 'Ă', 'ă', ...)
+        uint32_t stride;
+    };
+
+    /*
+    * simple case folding (status 'C' and 'S') from unicode 14.0 CaseFolding.txt,
+    * compressed into ranges, and sorted by first codepoint. ASCII is not included,
+    * since asciiInPlace() handles it.
+    */
+    static constexpr FoldRange foldtable[] =
+    {
+            {0x000B5, 0x000B5, 775, 1},
+            {0x000C0, 0x000D6, 32, 1},
+            {0x000D8, 0x000DE, 32, 1},
+            {0x00100, 0x0012E, 1, 2},
+            {0x00132, 0x00136, 1, 2},
+            {0x00139, 0x00147, 1, 2},
+            {0x0014A, 0x00176, 1, 2},
+            {0x00178, 0x00178, -121, 1},
+            {0x00179, 0x0017D, 1, 2},
+            {0x0017F, 0x0017F, -268, 1},
+            {0x00181, 0x00181, 210, 1},
+            {0x00182, 0x00184, 1, 2},
+            {0x00186, 0x00186, 206, 1},
+            {0x00187, 0x00187, 1, 1},
+            {0x00189, 0x0018A, 205, 1},
+            {0x0018B, 0x0018B, 1, 1},
+            {0x0018E, 0x0018E, 79, 1},
+            {0x0018F, 0x0018F, 202, 1},
+            {0x00190, 0x00190, 203, 1},
+            {0x00191, 0x00191, 1, 1},
+            {0x00193, 0x00193, 205, 1},
+            {0x00194, 0x00194, 207, 1},
+            {0x00196, 0x00196, 211, 1},
+            {0x00197, 0x00197, 209, 1},
+            {0x00198, 0x00198, 1, 1},
+            {0x0019C, 0x0019C, 211, 1},
+            {0x0019D, 0x0019D, 213, 1},
+            {0x0019F, 0x0019F, 214, 1},
+            {0x001A0, 0x001A4, 1, 2},
+            {0x001A6, 0x001A6, 218, 1},
+            {0x001A7, 0x001A7, 1, 1},
+            {0x001A9, 0x001A9, 218, 1},
+            {0x001AC, 0x001AC, 1, 1},
+            {0x001AE, 0x001AE, 218, 1},
+            {0x001AF, 0x001AF, 1, 1},
+            {0x001B1, 0x001B2, 217, 1},
+            {0x001B3, 0x001B5, 1, 2},
+            {0x001B7, 0x001B7, 219, 1},
+            {0x001B8, 0x001B8, 1, 1},
+            {0x001BC, 0x001BC, 1, 1},
+            {0x001C4, 0x001C4, 2, 1},
+            {0x001C5, 0x001C5, 1, 1},
+            {0x001C7, 0x001C7, 2, 1},
+            {0x001C8, 0x001C8, 1, 1},
+            {0x001CA, 0x001CA, 2, 1},
+            {0x001CB, 0x001DB, 1, 2},
+            {0x001DE, 0x001EE, 1, 2},
+            {0x001F1, 0x001F1, 2, 1},
+            {0x001F2, 0x001F4, 1, 2},
+            {0x001F6, 0x001F6, -97, 1},
+            {0x001F7, 0x001F7, -56, 1},
+            {0x001F8, 0x0021E, 1, 2},
+            {0x00220, 0x00220, -130, 1},
+            {0x00222, 0x00232, 1, 2},
+            {0x0023A, 0x0023A, 10795, 1},
+            {0x0023B, 0x0023B, 1, 1},
+            {0x0023D, 0x0023D, -163, 1},
+            {0x0023E, 0x0023E, 10792, 1},
+            {0x00241, 0x00241, 1, 1},
+            {0x00243, 0x00243, -195, 1},
+            {0x00244, 0x00244, 69, 1},
+            {0x00245, 0x00245, 71, 1},
+            {0x00246, 0x0024E, 1, 2},
+            {0x00345, 0x00345, 116, 1},
+            {0x00370, 0x00372, 1, 2},
+            {0x00376, 0x00376, 1, 1},
+            {0x0037F, 0x0037F, 116, 1},
+            {0x00386, 0x00386, 38, 1},
+            {0x00388, 0x0038A, 37, 1},
+            {0x0038C, 0x0038C, 64, 1},
+            {0x0038E, 0x0038F, 63, 1},
+            {0x00391, 0x003A1, 32, 1},
+            {0x003A3, 0x003AB, 32, 1},
+            {0x003C2, 0x003C2, 1, 1},
+            {0x003CF, 0x003CF, 8, 1},
+            {0x003D0, 0x003D0, -30, 1},
+            {0x003D1, 0x003D1, -25, 1},
+            {0x003D5, 0x003D5, -15, 1},
+            {0x003D6, 0x003D6, -22, 1},
+            {0x003D8, 0x003EE, 1, 2},
+            {0x003F0, 0x003F0, -54, 1},
+            {0x003F1, 0x003F1, -48, 1},
+            {0x003F4, 0x003F4, -60, 1},
+            {0x003F5, 0x003F5, -64, 1},
+            {0x003F7, 0x003F7, 1, 1},
+            {0x003F9, 0x003F9, -7, 1},
+            {0x003FA, 0x003FA, 1, 1},
+            {0x003FD, 0x003FF, -130, 1},
+            {0x00400, 0x0040F, 80, 1},
+            {0x00410, 0x0042F, 32, 1},
+            {0x00460, 0x00480, 1, 2},
+            {0x0048A, 0x004BE, 1, 2},
+            {0x004C0, 0x004C0, 15, 1},
+            {0x004C1, 0x004CD, 1, 2},
+            {0x004D0, 0x0052E, 1, 2},
+            {0x00531, 0x00556, 48, 1},
+            {0x010A0, 0x010C5, 7264, 1},
+            {0x010C7, 0x010C7, 7264, 1},
+            {0x010CD, 0x010CD, 7264, 1},
+            {0x013F8, 0x013FD, -8, 1},
+            {0x01C80, 0x01C80, -6222, 1},
+            {0x01C81, 0x01C81, -6221, 1},
+            {0x01C82, 0x01C82, -6212, 1},
+            {0x01C83, 0x01C84, -6210, 1},
+            {0x01C85, 0x01C85, -6211, 1},
+            {0x01C86, 0x01C86, -6204, 1},
+            {0x01C87, 0x01C87, -6180, 1},
+            {0x01C88, 0x01C88, 35267, 1},
+            {0x01C90, 0x01CBA, -3008, 1},
+            {0x01CBD, 0x01CBF, -3008, 1},
+            {0x01E00, 0x01E94, 1, 2},
+            {0x01E9B, 0x01E9B, -58, 1},
+            {0x01E9E, 0x01E9E, -7615, 1},
+            {0x01EA0, 0x01EFE, 1, 2},
+            {0x01F08, 0x01F0F, -8, 1},
+            {0x01F18, 0x01F1D, -8, 1},
+            {0x01F28, 0x01F2F, -8, 1},
+            {0x01F38, 0x01F3F, -8, 1},
+            {0x01F48, 0x01F4D, -8, 1},
+            {0x01F59, 0x01F5F, -8, 2},
+            {0x01F68, 0x01F6F, -8, 1},
+            {0x01F88, 0x01F8F, -8, 1},
+            {0x01F98, 0x01F9F, -8, 1},
+            {0x01FA8, 0x01FAF, -8, 1},
+            {0x01FB8, 0x01FB9, -8, 1},
+            {0x01FBA, 0x01FBB, -74, 1},
+            {0x01FBC, 0x01FBC, -9, 1},
+            {0x01FBE, 0x01FBE, -7173, 1},
+            {0x01FC8, 0x01FCB, -86, 1},
+            {0x01FCC, 0x01FCC, -9, 1},
+            {0x01FD8, 0x01FD9, -8, 1},
+            {0x01FDA, 0x01FDB, -100, 1},
+            {0x01FE8, 0x01FE9, -8, 1},
+            {0x01FEA, 0x01FEB, -112, 1},
+            {0x01FEC, 0x01FEC, -7, 1},
+            {0x01FF8, 0x01FF9, -128, 1},
+            {0x01FFA, 0x01FFB, -126, 1},
+            {0x01FFC, 0x01FFC, -9, 1},
+            {0x02126, 0x02126, -7517, 1},
+            {0x0212A, 0x0212A, -8383, 1},
+            {0x0212B, 0x0212B, -8262, 1},
+            {0x02132, 0x02132, 28, 1},
+            {0x02160, 0x0216F, 16, 1},
+            {0x02183, 0x02183, 1, 1},
+            {0x024B6, 0x024CF, 26, 1},
+            {0x02C00, 0x02C2F, 48, 1},
+            {0x02C60, 0x02C60, 1, 1},
+            {0x02C62, 0x02C62, -10743, 1},
+            {0x02C63, 0x02C63, -3814, 1},
+            {0x02C64, 0x02C64, -10727, 1},
+            {0x02C67, 0x02C6B, 1, 2},
+            {0x02C6D, 0x02C6D, -10780, 1},
+            {0x02C6E, 0x02C6E, -10749, 1},
+            {0x02C6F, 0x02C6F, -10783, 1},
+            {0x02C70, 0x02C70, -10782, 1},
+            {0x02C72, 0x02C72, 1, 1},
+            {0x02C75, 0x02C75, 1, 1},
+            {0x02C7E, 0x02C7F, -10815, 1},
+            {0x02C80, 0x02CE2, 1, 2},
+            {0x02CEB, 0x02CED, 1, 2},
+            {0x02CF2, 0x02CF2, 1, 1},
+            {0x0A640, 0x0A66C, 1, 2},
+            {0x0A680, 0x0A69A, 1, 2},
+            {0x0A722, 0x0A72E, 1, 2},
+            {0x0A732, 0x0A76E, 1, 2},
+            {0x0A779, 0x0A77B, 1, 2},
+            {0x0A77D, 0x0A77D, -35332, 1},
+            {0x0A77E, 0x0A786, 1, 2},
+            {0x0A78B, 0x0A78B, 1, 1},
+            {0x0A78D, 0x0A78D, -42280, 1},
+            {0x0A790, 0x0A792, 1, 2},
+            {0x0A796, 0x0A7A8, 1, 2},
+            {0x0A7AA, 0x0A7AA, -42308, 1},
+            {0x0A7AB, 0x0A7AB, -42319, 1},
+            {0x0A7AC, 0x0A7AC, -42315, 1},
+            {0x0A7AD, 0x0A7AD, -42305, 1},
+            {0x0A7AE, 0x0A7AE, -42308, 1},
+            {0x0A7B0, 0x0A7B0, -42258, 1},
+            {0x0A7B1, 0x0A7B1, -42282, 1},
+            {0x0A7B2, 0x0A7B2, -42261, 1},
+            {0x0A7B3, 0x0A7B3, 928, 1},
+            {0x0A7B4, 0x0A7C2, 1, 2},
+            {0x0A7C4, 0x0A7C4, -48, 1},
+            {0x0A7C5, 0x0A7C5, -42307, 1},
+            {0x0A7C6, 0x0A7C6, -35384, 1},
+            {0x0A7C7, 0x0A7C9, 1, 2},
+            {0x0A7D0, 0x0A7D0, 1, 1},
+            {0x0A7D6, 0x0A7D8, 1, 2},
+            {0x0A7F5, 0x0A7F5, 1, 1},
+            {0x0AB70, 0x0ABBF, -38864, 1},
+            {0x0FF21, 0x0FF3A, 32, 1},
+            {0x10400, 0x10427, 40, 1},
+            {0x104B0, 0x104D3, 40, 1},
+            {0x10570, 0x1057A, 39, 1},
+            {0x1057C, 0x1058A, 39, 1},
+            {0x1058C, 0x10592, 39, 1},
+            {0x10594, 0x10595, 39, 1},
+            {0x10C80, 0x10CB2, 64, 1},
+            {0x118A0, 0x118BF, 32, 1},
+            {0x16E40, 0x16E5F, 32, 1},
+            {0x1E900, 0x1E921, 34, 1},
+    };
+
+    inline uint32_t simpleFold(uint32_t cp)
+    {
+        auto end = std::end(foldtable);
+        auto it = std::upper_bound(std::begin(foldtable), end, cp, [](uint32_t val, const FoldRange& range)
+        {
+            return (val < range.first);
+        });
+        if(it != std::begin(foldtable))
+        {
+            --it;
+            if((cp <= it->last) && (((cp - it->first) % it->stride) == 0))
+            {
+                return uint32_t(int32_t(cp) + it->delta);
+            }
+        }
+        return cp;
+    }
+
+    /*
+    * lowercases $len bytes of $buf, as long as they're all ASCII.
+    * returns false as soon as a byte with the high bit set shows up - $buf is then
+    * only partially lowercased, and should be redone with utf8().
+    */
+    inline bool asciiInPlace(char* buf, size_t len)
+    {
+        size_t i;
+        uint64_t word;
+        uint64_t isgeA;
+        uint64_t isgtZ;
+        i = 0;
+        #if defined(CFILES_HAVE_SSE2)
+            const __m128i belowA = _mm_set1_epi8('A' - 1);
+            const __m128i aboveZ = _mm_set1_epi8('Z' + 1);
+            const __m128i caseBit = _mm_set1_epi8(0x20);
+            for(; (i + 16) <= len; i += 16)
+            {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+                // the high bit is the sign bit, so non-ASCII bytes are the only ones < 0 here
+                if(_mm_movemask_epi8(chunk) != 0)
+                {
+                    return false;
+                }
+                __m128i isupper = _mm_and_si128(_mm_cmpgt_epi8(chunk, belowA), _mm_cmplt_epi8(chunk, aboveZ));
+                chunk = _mm_or_si128(chunk, _mm_and_si128(isupper, caseBit));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(buf + i), chunk);
+            }
+        #endif
+        /*
+        * same thing, but on 8 bytes in a regular register: with the high bit of every byte
+        * known to be clear, adding to each byte can't carry into the next one - so the
+        * high bit of (byte + (0x80 - 'A')) says 'is >= A', and that of (byte + (0x7F - 'Z')) 'is > Z'.
+        */
+        for(; (i + 8) <= len; i += 8)
+        {
+            std::memcpy(&word, buf + i, 8);
+            if((word & 0x8080808080808080ULL) != 0)
+            {
+                return false;
+            }
+            isgeA = (word + (0x0101010101010101ULL * (0x80 - 'A')));
+            isgtZ = (word + (0x0101010101010101ULL * (0x7F - 'Z')));
+            word |= (((isgeA & ~isgtZ) & 0x8080808080808080ULL) >> 2);
+            std::memcpy(buf + i, &word, 8);
+        }
+        for(; i < len; i++)
+        {
+            if((buf[i] & 0x80) != 0)
+            {
+                return false;
+            }
+            if((buf[i] >= 'A') && (buf[i] <= 'Z'))
+            {
+                buf[i] |= 0x20;
+            }
+        }
+        return true;
+    }
+
+    // decodes one codepoint at $src. on malformed input, returns false, and leaves $cp/$seqlen alone.
+    inline bool utf8Decode(const unsigned char* src, size_t avail, uint32_t& cp, size_t& seqlen)
+    {
+        size_t i;
+        size_t need;
+        uint32_t val;
+        uint32_t minval;
+        if(src[0] < 0xC2)
+        {
+            return false;
+        }
+        else if(src[0] < 0xE0)
+        {
+            need = 2;
+            val = (src[0] & 0x1F);
+            minval = 0x80;
+        }
+        else if(src[0] < 0xF0)
+        {
+            need = 3;
+            val = (src[0] & 0x0F);
+            minval = 0x800;
+        }
+        else if(src[0] < 0xF5)
+        {
+            need = 4;
+            val = (src[0] & 0x07);
+            minval = 0x10000;
+        }
+        else
+        {
+            return false;
+        }
+        if(avail < need)
+        {
+            return false;
+        }
+        for(i=1; i<need; i++)
+        {
+            if((src[i] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            val = ((val << 6) | (src[i] & 0x3F));
+        }
+        if((val < minval) || (val > 0x10FFFF) || ((val >= 0xD800) && (val <= 0xDFFF)))
+        {
+            return false;
+        }
+        cp = val;
+        seqlen = need;
+        return true;
+    }
+
+    inline void utf8Encode(uint32_t cp, std::string& out)
+    {
+        if(cp < 0x80)
+        {
+            out.push_back(char(cp));
+        }
+        else if(cp < 0x800)
+        {
+            out.push_back(char(0xC0 | (cp >> 6)));
+            out.push_back(char(0x80 | (cp & 0x3F)));
+        }
+        else if(cp < 0x10000)
+        {
+            out.push_back(char(0xE0 | (cp >> 12)));
+            out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(char(0x80 | (cp & 0x3F)));
+        }
+        else
+        {
+            out.push_back(char(0xF0 | (cp >> 18)));
+            out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(char(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    /*
+    * folds $len bytes of UTF-8 at $src into $out (which is cleared first).
+    * bytes that aren't valid UTF-8 are copied as-is, since filenames aren't
+    * guaranteed to be valid anything.
+    */
+    inline void utf8(const char* src, size_t len, std::string& out)
+    {
+        size_t i;
+        size_t seqlen;
+        uint32_t cp;
+        const unsigned char* usrc;
+        usrc = reinterpret_cast<const unsigned char*>(src);
+        out.clear();
+        i = 0;
+        while(i < len)
+        {
+            if(usrc[i] < 0x80)
+            {
+                out.push_back(((usrc[i] >= 'A') && (usrc[i] <= 'Z')) ? char(usrc[i] | 0x20) : src[i]);
+                i++;
+            }
+            else if(utf8Decode(usrc + i, len - i, cp, seqlen))
+            {
+                utf8Encode(simpleFold(cp), out);
+                i += seqlen;
+            }
+            else
+            {
+                out.push_back(src[i]);
+                i++;
+            }
+        }
+    }
+
+    /*
+    * writes the case-folded form of $in to $out.
+    * $out is meant to be reused: once its capacity has grown large enough, this doesn't allocate.
+    */
+    inline void fold(std::string_view in, std::string& out)
+    {
+        out.assign(in);
+        if(!asciiInPlace(out.data(), out.size()))
+        {
+            utf8(in.data(), in.size(), out);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+/*
+* what '--checkpoint' saves, and '--resume' continues from: the directories that are yet to
+* be read, and everything counted from those that were. DirWalker only takes one while none
+* of its workers is in the middle of a directory, so every directory is either counted in
+* full, or still pending - never both, and never half.
+*
+* what was counted comes last, and is written and read by CountFiles, straight to and from
+* the file - it can get far larger than anything else in there, so it has no length (or
+* limit) of its own. `settings` holds whatever options change the counts, so a checkpoint
+* can't be resumed with options it wasn't made with.
+*/
+
+#pragma once
+
+#include "glue.h"
+#include "binio.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <cstdio>
+
+struct Checkpoint
+{
+    // a directory yet to be read, as DirWalker has it queued
+    struct Pending
+    {
+        std::string path;
+        uint64_t depth;
+        // index into `roots`
+        uint64_t root;
+    };
+
+    static constexpr char fileMagic[8] = {'C', 'X', 'C', 'K', 'P', '0', '0', '2'};
+
+    std::string settings;
+    // Config::starttime of the walk that was interrupted, which '--mode=age' is relative to
+    int64_t starttime = 0;
+    std::vector<std::string> roots;
+    std::vector<Pending> pending;
+    // with '--follow', every directory read so far, as (st_dev, st_ino)
+    std::vector<std::pair<uint64_t, uint64_t>> visited;
+    // after load(), the file, at what was counted
+    std::fstream counts;
+
+    // reads everything up to what was counted, which is left to be read from `counts`
+    bool load(const std::string& path)
+    {
+        uint64_t count;
+        char magic[sizeof(fileMagic)];
+        auto& fh = counts;
+        fh.open(path, std::ios::in | std::ios::binary);
+        if(!fh.good())
+        {
+            return false;
+        }
+        if(!fh.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), fileMagic))
+        {
+            return false;
+        }
+        if(!BinIO::readString(fh, settings) || !BinIO::readVal(fh, starttime) || !BinIO::readVal(fh, count))
+        {
+            return false;
+        }
+        // counts aren't trusted for sizing anything up front; a bogus one just runs out of file
+        roots.clear();
+        while(count-- > 0)
+        {
+            std::string root;
+            if(!BinIO::readString(fh, root))
+            {
+                return false;
+            }
+            roots.push_back(std::move(root));
+        }
+        if(!BinIO::readVal(fh, count))
+        {
+            return false;
+        }
+        pending.clear();
+        while(count-- > 0)
+        {
+            Pending job;
+            if(!BinIO::readString(fh, job.path) || !BinIO::readVal(fh, job.depth) || !BinIO::readVal(fh, job.root) || (job.root >= roots.size()))
+            {
+                return false;
+            }
+            pending.push_back(std::move(job));
+        }
+        if(!BinIO::readVal(fh, count))
+        {
+            return false;
+        }
+        visited.clear();
+        while(count-- > 0)
+        {
+            std::pair<uint64_t, uint64_t> vis;
+            if(!BinIO::readVal(fh, vis.first) || !BinIO::readVal(fh, vis.second))
+            {
+                return false;
+            }
+            visited.push_back(vis);
+        }
+        return true;
+    }
+
+    /*
+    * written to a temporary file first, so getting killed while saving leaves the last
+    * checkpoint intact. $writecounts writes what was counted, after everything else.
+    */
+    bool save(const std::string& path, const std::function<void(std::ostream&)>& writecounts) const
+    {
+        std::string tmppath;
+        tmppath = (path + ".tmp");
+        {
+            std::fstream fh(tmppath, std::ios::out | std::ios::binary | std::ios::trunc);
+            if(!fh.good())
+            {
+                return false;
+            }
+            fh.write(fileMagic, sizeof(fileMagic));
+            BinIO::writeString(fh, settings);
+            BinIO::writeVal(fh, starttime);
+            BinIO::writeVal(fh, uint64_t(roots.size()));
+            for(const auto& root: roots)
+            {
+                BinIO::writeString(fh, root);
+            }
+            BinIO::writeVal(fh, uint64_t(pending.size()));
+            for(const auto& job: pending)
+            {
+                BinIO::writeString(fh, job.path);
+                BinIO::writeVal(fh, job.depth);
+                BinIO::writeVal(fh, job.root);
+            }
+            BinIO::writeVal(fh, uint64_t(visited.size()));
+            for(const auto& vis: visited)
+            {
+                BinIO::writeVal(fh, vis.first);
+                BinIO::writeVal(fh, vis.second);
+            }
+            writecounts(fh);
+            if(!fh.flush())
+            {
+                return false;
+            }
+        }
+        return (std::rename(tmppath.c_str(), path.c_str()) == 0);
+    }
+};
@@ -0,0 +1,230 @@
+
+/*
+* what '--cache' keeps between runs: the listing of every directory that was read, keyed by
+* (st_dev, st_ino), along with the directory's mtime and ctime. adding, removing or renaming
+* an entry updates both, so as long as they're unchanged, the listing can be used as-is
+* instead of reading the directory again.
+*
+* it's the listing that's cached, and not what was counted from it: a file's size or mtime
+* changes without its directory noticing, so anything that needs those is still stat()'d.
+* that also makes one cache file good for every mode and option.
+*
+* entries are read-only while walking (loaded ones in m_old), and what's seen during the walk
+* goes into m_new, which is what's saved - so directories that are gone also drop out of it.
+*/
+
+#pragma once
+
+#include "glue.h"
+#include "binio.h"
+
+#if defined(COE_ISUNIXLIKE)
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+
+class DirCache
+{
+    public:
+        struct Record
+        {
+            std::string name;
+            uint64_t ino;
+            // d_type, as readdir() gave it
+            unsigned char type;
+            // what the walker made of it; opaque to this class
+            unsigned char kind;
+        };
+
+        struct Listing
+        {
+            int64_t mtime = 0;
+            int64_t ctime = 0;
+            std::vector<Record> records;
+        };
+
+    private:
+        using Key = std::pair<uint64_t, uint64_t>;
+
+        static constexpr char fileMagic[8] = {'C', 'X', 'D', 'I', 'R', '0', '0', '1'};
+
+    private:
+        std::map<Key, Listing> m_old;
+        std::map<Key, Listing> m_new;
+        std::mutex m_lock;
+        // directories changed after this (nanoseconds since the epoch) aren't stored; see store()
+        int64_t m_notafter = 0;
+        std::atomic<size_t> m_hits{0};
+        std::atomic<size_t> m_misses{0};
+
+    private:
+        static int64_t stampOf(time_t sec, long nsec)
+        {
+            return ((int64_t(sec) * 1000000000) + nsec);
+        }
+
+        static int64_t mtimeOf(const struct stat& st)
+        {
+            #if defined(COE_ISLINUX)
+                return stampOf(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+            #else
+                return stampOf(st.st_mtime, 0);
+            #endif
+        }
+
+        static int64_t ctimeOf(const struct stat& st)
+        {
+            #if defined(COE_ISLINUX)
+                return stampOf(st.st_ctim.tv_sec, st.st_ctim.tv_nsec);
+            #else
+                return stampOf(st.st_ctime, 0);
+            #endif
+        }
+
+    public:
+        /*
+        * a directory that changes within the same timestamp tick as it was read in would look
+        * unchanged next time, despite not being so - so anything changed in the second before
+        * $start (when the walk started) isn't trusted, and gets read again next time.
+        */
+        void setStart(int64_t start)
+        {
+            m_notafter = (start - 1000000000);
+        }
+
+        // the cached listing of the directory $st is about, if it's still current; nullptr otherwise
+        const Listing* lookup(const struct stat& st)
+        {
+            auto it = m_old.find(Key(st.st_dev, st.st_ino));
+            if((it == m_old.end()) || (it->second.mtime != mtimeOf(st)) || (it->second.ctime != ctimeOf(st)))
+            {
+                m_misses++;
+                return nullptr;
+            }
+            m_hits++;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_new[it->first] = it->second;
+            }
+            return &it->second;
+        }
+
+        // remembers $records as the listing of the directory $st is about
+        void store(const struct stat& st, std::vector<Record>&& records)
+        {
+            Listing listing;
+            listing.mtime = mtimeOf(st);
+            listing.ctime = ctimeOf(st);
+            if(std::max(listing.mtime, listing.ctime) >= m_notafter)
+            {
+                return;
+            }
+            listing.records = std::move(records);
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_new[Key(st.st_dev, st.st_ino)] = std::move(listing);
+        }
+
+        size_t hits() const
+        {
+            return m_hits;
+        }
+
+        size_t misses() const
+        {
+            return m_misses;
+        }
+
+        // a file that doesn't exist yet is fine; anything else that can't be read is not
+        bool load(const std::string& path)
+        {
+            Key key;
+            uint32_t len;
+            uint64_t count;
+            uint64_t nrec;
+            char magic[sizeof(fileMagic)];
+            std::fstream fh(path, std::ios::in | std::ios::binary);
+            if(!fh.good())
+            {
+                return true;
+            }
+            if(!fh.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), fileMagic) || !BinIO::readVal(fh, count))
+            {
+                return false;
+            }
+            while(count-- > 0)
+            {
+                Listing listing;
+                // a few million entries in one directory is already plenty; anything above is garbage
+                if(!BinIO::readVal(fh, key.first) || !BinIO::readVal(fh, key.second) || !BinIO::readVal(fh, listing.mtime) || !BinIO::readVal(fh, listing.ctime) || !BinIO::readVal(fh, nrec) || (nrec > (uint64_t(1) << 26)))
+                {
+                    m_old.clear();
+                    return false;
+                }
+                listing.records.resize(nrec);
+                for(auto& rec: listing.records)
+                {
+                    if(!BinIO::readVal(fh, rec.ino) || !BinIO::readVal(fh, rec.type) || !BinIO::readVal(fh, rec.kind) || !BinIO::readVal(fh, len))
+                    {
+                        m_old.clear();
+                        return false;
+                    }
+                    rec.name.resize(len);
+                    if(!fh.read(rec.name.data(), len))
+                    {
+                        m_old.clear();
+                        return false;
+                    }
+                }
+                m_old.emplace(key, std::move(listing));
+            }
+            return true;
+        }
+
+        // written to a temporary file first, so an interrupted save leaves the old cache intact
+        bool save(const std::string& path)
+        {
+            std::string tmppath;
+            tmppath = (path + ".tmp");
+            {
+                std::fstream fh(tmppath, std::ios::out | std::ios::binary | std::ios::trunc);
+                if(!fh.good())
+                {
+                    return false;
+                }
+                fh.write(fileMagic, sizeof(fileMagic));
+                BinIO::writeVal(fh, uint64_t(m_new.size()));
+                for(const auto& it: m_new)
+                {
+                    BinIO::writeVal(fh, it.first.first);
+                    BinIO::writeVal(fh, it.first.second);
+                    BinIO::writeVal(fh, it.second.mtime);
+                    BinIO::writeVal(fh, it.second.ctime);
+                    BinIO::writeVal(fh, uint64_t(it.second.records.size()));
+                    for(const auto& rec: it.second.records)
+                    {
+                        BinIO::writeVal(fh, rec.ino);
+                        BinIO::writeVal(fh, rec.type);
+                        BinIO::writeVal(fh, rec.kind);
+                        BinIO::writeVal(fh, uint32_t(rec.name.size()));
+                        fh.write(rec.name.data(), rec.name.size());
+                    }
+                }
+                if(!fh.good())
+                {
+                    return false;
+                }
+            }
+            return (std::rename(tmppath.c_str(), path.c_str()) == 0);
+        }
+};
+
+#endif
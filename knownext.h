@@ -0,0 +1,377 @@
+
+/*
+* a compile-time perfect hash over the file extensions that make up the bulk of
+* pretty much any tree. hits land in fixed counter slots, so they never touch ExtList.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <iterator>
+#include <string_view>
+
+/*
+* hash-and-displace perfect hashing: keys are first spread over $bucketcount buckets,
+* then for each bucket (largest first) a seed is searched for that puts all of its keys
+* into slots that are still free. a lookup is then just two hashes, and one comparison.
+* everything is constexpr, so tables over fixed key lists are built by the compiler -
+* but it works just the same at runtime, as long as the keys fit into $maxkeys.
+*/
+template<size_t maxkeys, size_t tablesize>
+class PerfectHash
+{
+    static_assert((tablesize & (tablesize - 1)) == 0, "tablesize must be a power of two");
+    static_assert(maxkeys < tablesize, "tablesize must be larger than maxkeys");
+
+    public:
+        static constexpr size_t capacity = maxkeys;
+        static constexpr size_t bucketcount = ((maxkeys / 2) + 1);
+        static constexpr uint16_t emptyslot = 0xFFFF;
+        static constexpr uint16_t maxseed = 0xFFFF;
+
+    private:
+        std::array<std::string_view, maxkeys> m_keys = {};
+        std::array<uint16_t, tablesize> m_slots = {};
+        std::array<uint16_t, bucketcount> m_seeds = {};
+        size_t m_count = 0;
+        bool m_ok = false;
+
+    public:
+        static constexpr uint64_t hashKey(std::string_view str, uint64_t seed)
+        {
+            // (c++17 constexpr wants every local initialized right away)
+            uint64_t h = (0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL));
+            for(auto ch: str)
+            {
+                h ^= uint8_t(ch);
+                h *= 0x100000001b3ULL;
+            }
+            h ^= (h >> 29);
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= (h >> 32);
+            return h;
+        }
+
+    private:
+        constexpr size_t bucketOf(std::string_view str) const
+        {
+            return (hashKey(str, 0) % bucketcount);
+        }
+
+        constexpr size_t slotOf(std::string_view str, uint16_t seed) const
+        {
+            return (hashKey(str, seed) & (tablesize - 1));
+        }
+
+        // tries to place every key of $bucket using $seed. either all of them get placed, or none.
+        constexpr bool tryPlace(size_t bucket, uint16_t seed)
+        {
+            size_t i = 0;
+            size_t j = 0;
+            size_t slot = 0;
+            size_t nplaced = 0;
+            std::array<size_t, maxkeys> placed = {};
+            for(i=0; i<m_count; i++)
+            {
+                if(bucketOf(m_keys[i]) != bucket)
+                {
+                    continue;
+                }
+                slot = slotOf(m_keys[i], seed);
+                if(m_slots[slot] != emptyslot)
+                {
+                    for(j=0; j<nplaced; j++)
+                    {
+                        m_slots[placed[j]] = emptyslot;
+                    }
+                    return false;
+                }
+                m_slots[slot] = uint16_t(i);
+                placed[nplaced++] = slot;
+            }
+            m_seeds[bucket] = seed;
+            return true;
+        }
+
+        constexpr bool build()
+        {
+            size_t i = 0;
+            size_t b = 0;
+            size_t best = 0;
+            uint16_t seed = 0;
+            std::array<size_t, bucketcount> sizes = {};
+            for(auto& slot: m_slots)
+            {
+                slot = emptyslot;
+            }
+            for(i=0; i<m_count; i++)
+            {
+                sizes[bucketOf(m_keys[i])]++;
+            }
+            // biggest buckets first, while there's still plenty of room
+            while(true)
+            {
+                best = bucketcount;
+                for(b=0; b<bucketcount; b++)
+                {
+                    if((sizes[b] > 0) && ((best == bucketcount) || (sizes[b] > sizes[best])))
+                    {
+                        best = b;
+                    }
+                }
+                if(best == bucketcount)
+                {
+                    return true;
+                }
+                for(seed=1; seed<maxseed; seed++)
+                {
+                    if(tryPlace(best, seed))
+                    {
+                        break;
+                    }
+                }
+                if(seed == maxseed)
+                {
+                    return false;
+                }
+                sizes[best] = 0;
+            }
+        }
+
+    public:
+        constexpr PerfectHash()
+        {
+        }
+
+        /*
+        * keys must be unique, and outlive the table (string literals, usually).
+        * check ok() afterwards - building fails if there are too many keys.
+        */
+        constexpr PerfectHash(const std::string_view* keys, size_t count)
+        {
+            size_t i = 0;
+            if(count > maxkeys)
+            {
+                return;
+            }
+            for(i=0; i<count; i++)
+            {
+                m_keys[i] = keys[i];
+            }
+            m_count = count;
+            m_ok = build();
+        }
+
+        constexpr bool ok() const
+        {
+            return m_ok;
+        }
+
+        constexpr size_t size() const
+        {
+            return m_count;
+        }
+
+        constexpr std::string_view key(size_t idx) const
+        {
+            return m_keys[idx];
+        }
+
+        // index of $str in the list of keys, or -1 if it isn't in there
+        constexpr int find(std::string_view str) const
+        {
+            if(m_count == 0)
+            {
+                return -1;
+            }
+            uint16_t idx = m_slots[slotOf(str, m_seeds[bucketOf(str)])];
+            if((idx != emptyslot) && (m_keys[idx] == str))
+            {
+                return idx;
+            }
+            return -1;
+        }
+};
+
+/*
+* extensions that get their own counter slot. the order here is irrelevant, since the
+* slots are merged back into ExtList (in the order they were first seen) before printing.
+* all lowercase - with '--nocase' everything gets a slot, without it only lowercase spellings do.
+*/
+inline constexpr std::string_view knownextlist[] =
+{
+    // c, c++, and friends
+    ".c", ".h", ".cpp", ".hpp", ".cc", ".hh", ".cxx", ".hxx", ".inl", ".ipp", ".tcc",
+    ".o", ".a", ".so", ".obj", ".lib", ".dll", ".exe", ".pdb", ".d", ".s", ".asm",
+    // everything else that gets compiled, or interpreted
+    ".cs", ".java", ".class", ".jar", ".kt", ".scala", ".go", ".rs", ".swift", ".m",
+    ".py", ".pyc", ".pyi", ".rb", ".pl", ".pm", ".php", ".lua", ".sh", ".bat", ".ps1",
+    ".js", ".mjs", ".cjs", ".ts", ".jsx", ".tsx", ".vue", ".map", ".wasm",
+    // build stuff
+    ".in", ".am", ".ac", ".m4", ".mk", ".cmake", ".lock", ".patch", ".diff",
+    // text, markup, config
+    ".txt", ".md", ".rst", ".log", ".csv", ".tsv", ".json", ".xml", ".html", ".htm",
+    ".css", ".scss", ".yml", ".yaml", ".toml", ".ini", ".cfg", ".conf", ".sql",
+    // images, media, fonts, documents
+    ".jpg", ".jpeg", ".png", ".gif", ".svg", ".ico", ".bmp", ".webp", ".tif", ".tiff",
+    ".mp3", ".mp4", ".wav", ".avi", ".mkv", ".mov", ".ttf", ".otf", ".woff", ".woff2",
+    ".pdf", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx", ".odt",
+    // archives, and the rest
+    ".zip", ".gz", ".tgz", ".tar", ".bz2", ".xz", ".zst", ".7z", ".rar", ".deb", ".rpm",
+    ".bak", ".tmp", ".swp", ".old", ".orig", ".db", ".sqlite", ".dat", ".bin", ".iso", ".img",
+    ".pem", ".crt", ".key", ".sample", ".pack", ".idx", ".rev",
+};
+
+inline constexpr size_t knownextcount = std::size(knownextlist);
+
+inline constexpr PerfectHash<knownextcount, 512> knownexts(knownextlist, knownextcount);
+
+static_assert(knownexts.ok(), "failed to build perfect hash for knownextlist - duplicate entries?");
+
+/*
+* languages for '--mode=language'. Language::Other catches everything that
+* isn't in languagemap below.
+*/
+enum class Language: uint8_t
+{
+    C, Cpp, CSharp, ObjectiveC, Java, Kotlin, Scala, Groovy, Go, Rust, Swift, Zig, D, Nim, Dart,
+    Python, Ruby, Perl, PHP, Lua, Tcl, R, Julia, Haskell, OCaml, Erlang, Elixir, Clojure, Lisp,
+    Fortran, Pascal, Assembly, Shell, PowerShell, Batch, JavaScript, TypeScript, Vue, WebAssembly,
+    HTML, CSS, Markdown, ReStructuredText, TeX, Text, JSON, XML, YAML, TOML, INI, SQL, Protobuf,
+    Makefile, CMake, Autotools, Meson, Bazel, Dockerfile, VimScript, EmacsLisp,
+    Other,
+};
+
+inline constexpr std::string_view languagenames[] =
+{
+    "C", "C++", "C#", "Objective-C", "Java", "Kotlin", "Scala", "Groovy", "Go", "Rust", "Swift", "Zig", "D", "Nim", "Dart",
+    "Python", "Ruby", "Perl", "PHP", "Lua", "Tcl", "R", "Julia", "Haskell", "OCaml", "Erlang", "Elixir", "Clojure", "Lisp",
+    "Fortran", "Pascal", "Assembly", "Shell", "PowerShell", "Batch", "JavaScript", "TypeScript", "Vue", "WebAssembly",
+    "HTML", "CSS", "Markdown", "reStructuredText", "TeX", "Text", "JSON", "XML", "YAML", "TOML", "INI", "SQL", "Protobuf",
+    "Makefile", "CMake", "Autotools", "Meson", "Bazel", "Dockerfile", "Vim script", "Emacs Lisp",
+    "Other",
+};
+
+inline constexpr size_t languagecount = std::size(languagenames);
+
+static_assert(languagecount == (size_t(Language::Other) + 1), "languagenames does not match enum Language");
+
+struct LanguageEntry
+{
+    // either an extension (with the dot), or a complete filename
+    std::string_view key;
+    Language lang;
+};
+
+/*
+* extensions are looked up as-is first, then lowercased - so only spellings where
+* case actually matters (like '.C' for C++) need to be listed twice.
+*/
+inline constexpr LanguageEntry languagemap[] =
+{
+    {".c", Language::C}, {".h", Language::C},
+    {".cpp", Language::Cpp}, {".cc", Language::Cpp}, {".cxx", Language::Cpp}, {".c++", Language::Cpp}, {".C", Language::Cpp},
+    {".hpp", Language::Cpp}, {".hh", Language::Cpp}, {".hxx", Language::Cpp}, {".h++", Language::Cpp},
+    {".inl", Language::Cpp}, {".ipp", Language::Cpp}, {".tcc", Language::Cpp}, {".tpp", Language::Cpp}, {".cppm", Language::Cpp},
+    {".ixx", Language::Cpp},
+    {".cs", Language::CSharp}, {".csx", Language::CSharp},
+    {".m", Language::ObjectiveC}, {".mm", Language::ObjectiveC},
+    {".java", Language::Java}, {".kt", Language::Kotlin}, {".kts", Language::Kotlin}, {".scala", Language::Scala}, {".sc", Language::Scala},
+    {".groovy", Language::Groovy}, {".gradle", Language::Groovy}, {"Jenkinsfile", Language::Groovy},
+    {".go", Language::Go}, {".rs", Language::Rust}, {".swift", Language::Swift}, {".zig", Language::Zig}, {".d", Language::D},
+    {".di", Language::D}, {".nim", Language::Nim}, {".dart", Language::Dart},
+    {".py", Language::Python}, {".pyi", Language::Python}, {".pyw", Language::Python}, {".pyx", Language::Python}, {".pxd", Language::Python},
+    {"SConstruct", Language::Python}, {"SConscript", Language::Python},
+    {".rb", Language::Ruby}, {".rake", Language::Ruby}, {".gemspec", Language::Ruby}, {"Rakefile", Language::Ruby}, {"Gemfile", Language::Ruby},
+    {"Vagrantfile", Language::Ruby},
+    {".pl", Language::Perl}, {".pm", Language::Perl}, {".t", Language::Perl}, {".pod", Language::Perl},
+    {".php", Language::PHP}, {".phtml", Language::PHP}, {".lua", Language::Lua}, {".tcl", Language::Tcl}, {".r", Language::R},
+    {".jl", Language::Julia}, {".hs", Language::Haskell}, {".lhs", Language::Haskell}, {".ml", Language::OCaml}, {".mli", Language::OCaml},
+    {".erl", Language::Erlang}, {".hrl", Language::Erlang}, {".ex", Language::Elixir}, {".exs", Language::Elixir},
+    {".clj", Language::Clojure}, {".cljs", Language::Clojure}, {".cljc", Language::Clojure}, {".edn", Language::Clojure},
+    {".lisp", Language::Lisp}, {".lsp", Language::Lisp}, {".cl", Language::Lisp}, {".scm", Language::Lisp}, {".rkt", Language::Lisp},
+    {".f", Language::Fortran}, {".for", Language::Fortran}, {".f77", Language::Fortran}, {".f90", Language::Fortran}, {".f95", Language::Fortran},
+    {".f03", Language::Fortran}, {".pas", Language::Pascal}, {".pp", Language::Pascal}, {".dpr", Language::Pascal},
+    {".s", Language::Assembly}, {".S", Language::Assembly}, {".asm", Language::Assembly}, {".nasm", Language::Assembly},
+    {".sh", Language::Shell}, {".bash", Language::Shell}, {".zsh", Language::Shell}, {".ksh", Language::Shell}, {".fish", Language::Shell},
+    {".bashrc", Language::Shell}, {".profile", Language::Shell}, {".bash_profile", Language::Shell}, {".zshrc", Language::Shell},
+    {".ps1", Language::PowerShell}, {".psm1", Language::PowerShell}, {".psd1", Language::PowerShell},
+    {".bat", Language::Batch}, {".cmd", Language::Batch},
+    {".js", Language::JavaScript}, {".mjs", Language::JavaScript}, {".cjs", Language::JavaScript}, {".jsx", Language::JavaScript},
+    {".ts", Language::TypeScript}, {".tsx", Language::TypeScript}, {".mts", Language::TypeScript}, {".cts", Language::TypeScript},
+    {".vue", Language::Vue}, {".wasm", Language::WebAssembly}, {".wat", Language::WebAssembly},
+    {".html", Language::HTML}, {".htm", Language::HTML}, {".xhtml", Language::HTML},
+    {".css", Language::CSS}, {".scss", Language::CSS}, {".sass", Language::CSS}, {".less", Language::CSS},
+    {".md", Language::Markdown}, {".markdown", Language::Markdown}, {".rst", Language::ReStructuredText},
+    {".tex", Language::TeX}, {".sty", Language::TeX}, {".cls", Language::TeX}, {".bib", Language::TeX},
+    {".txt", Language::Text}, {"README", Language::Text}, {"LICENSE", Language::Text}, {"COPYING", Language::Text},
+    {"AUTHORS", Language::Text}, {"ChangeLog", Language::Text}, {"NEWS", Language::Text},
+    {".json", Language::JSON}, {".jsonc", Language::JSON}, {".json5", Language::JSON},
+    {".xml", Language::XML}, {".xsd", Language::XML}, {".xsl", Language::XML}, {".xslt", Language::XML}, {".plist", Language::XML},
+    {".yml", Language::YAML}, {".yaml", Language::YAML}, {".toml", Language::TOML}, {"Cargo.lock", Language::TOML},
+    {".ini", Language::INI}, {".cfg", Language::INI}, {".conf", Language::INI}, {".sql", Language::SQL},
+    {".proto", Language::Protobuf},
+    {".mk", Language::Makefile}, {".mak", Language::Makefile}, {"Makefile", Language::Makefile}, {"makefile", Language::Makefile},
+    {"GNUmakefile", Language::Makefile}, {"Kbuild", Language::Makefile},
+    {".cmake", Language::CMake}, {"CMakeLists.txt", Language::CMake},
+    {".ac", Language::Autotools}, {".am", Language::Autotools}, {".m4", Language::Autotools}, {"configure.ac", Language::Autotools},
+    {"Makefile.am", Language::Autotools}, {"Makefile.in", Language::Autotools},
+    {"meson.build", Language::Meson}, {"meson_options.txt", Language::Meson},
+    {".bzl", Language::Bazel}, {".bazel", Language::Bazel}, {"BUILD", Language::Bazel}, {"WORKSPACE", Language::Bazel},
+    {"Dockerfile", Language::Dockerfile}, {"Containerfile", Language::Dockerfile}, {".dockerfile", Language::Dockerfile},
+    {".vim", Language::VimScript}, {".vimrc", Language::VimScript}, {".el", Language::EmacsLisp}, {".emacs", Language::EmacsLisp},
+};
+
+inline constexpr size_t languagemapcount = std::size(languagemap);
+
+template<size_t count>
+constexpr std::array<std::string_view, count> languageKeys(const LanguageEntry (&entries)[count])
+{
+    size_t i = 0;
+    std::array<std::string_view, count> keys = {};
+    for(i=0; i<count; i++)
+    {
+        keys[i] = entries[i].key;
+    }
+    return keys;
+}
+
+inline constexpr std::array<std::string_view, languagemapcount> languagekeys = languageKeys(languagemap);
+
+inline constexpr PerfectHash<languagemapcount, 512> languagetable(languagekeys.data(), languagemapcount);
+
+static_assert(languagetable.ok(), "failed to build perfect hash for languagemap - duplicate entries?");
+
+// reverse of languagenames; Language::Other for names that aren't in there
+inline constexpr Language languageByName(std::string_view name)
+{
+    size_t i = 0;
+    for(i=0; i<languagecount; i++)
+    {
+        if(languagenames[i] == name)
+        {
+            return Language(i);
+        }
+    }
+    return Language::Other;
+}
+
+// filenames are checked before extensions, so that e.g. 'CMakeLists.txt' isn't just text
+inline constexpr Language languageOf(std::string_view filename, std::string_view ext, std::string_view lowerext)
+{
+    int idx = languagetable.find(filename);
+    if((idx < 0) && (ext.size() > 1))
+    {
+        idx = languagetable.find(ext);
+        if(idx < 0)
+        {
+            idx = languagetable.find(lowerext);
+        }
+    }
+    if(idx < 0)
+    {
+        return Language::Other;
+    }
+    return languagemap[idx].lang;
+}
@@ -10,22 +10,53 @@
 #include <list>
 #include <deque>
 #include <set>
+#include <array>
+#include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
 #include <functional>
 #include <string>
+#include <sstream>
+#include <cstring>
 #include <cstdio>
+#include <ctime>
+#include <chrono>
 #if defined(_WIN32)
     #include <io.h>
     #include <fcntl.h>
 #endif
+#if defined(COE_ISUNIXLIKE)
+    #include <pwd.h>
+    #include <unistd.h>
+    #include <sys/resource.h>
+#endif
+#if defined(COE_ISLINUX)
+    #include <sys/syscall.h>
+#endif
 
 #include "find.hpp"
 #include "optionparser.hpp"
+#include "sketches.h"
+#include "casefold.h"
+#include "knownext.h"
+#include "walker.h"
+#include "watcher.h"
+#include "checkpoint.h"
 
 #if defined(_MSC_VER)
     #define fileno _fileno
     #define isatty _isatty
 #endif
 
+/* statx() lets metadata calls ask for just the fields they need (glibc 2.28+) */
+#if defined(COE_ISLINUX) && defined(STATX_MTIME)
+    #define CFILES_HAVE_STATX
+#endif
+
 #if defined(_MAX_PATH)
     #define CFILES_MAXPATHLEN _MAX_PATH
 #elif defined(PATH_MAX)
@@ -41,12 +72,66 @@ enum class SortKind
     Extension,
     Stem,
     Filename,
+    // counts languages (see languagemap in knownext.h) instead of keys
+    Language,
+    // keyed by extension, like SortKind::Extension, but also sums up file sizes
+    Size,
+    // file counts and sizes per directory subtree (see DirTable)
+    Rollup,
+    // keyed by extension, like SortKind::Extension, but counted per directory depth (see BucketTable)
+    Depth,
+    // same as Depth, but counted by age of the last modification (see agenames)
+    Age,
+    // file counts and bytes per extension, per owning user
+    Owner,
+};
+
+// where keys end up - derived from Config, see Tally::sinkKind()
+enum class SinkKind
+{
+    // ExtList
+    Exact,
+    // SpaceSaving; '--approx'
+    Approx,
+    // HyperLogLog; '--cardinality'
+    Cardinality,
+    // a plain set, printing keys the moment they're first seen; '--stream'
+    Stream,
+};
+
+/*
+* the options that would otherwise be checked for every single item, as compile-time constants.
+* Tally::withPipeline() picks the matching instantiation once per walk, so the
+* per-item code (handleItem and everything below it) carries no configuration branches.
+*/
+template<SortKind kindv, bool icasev, bool rejectnoextv, SinkKind sinkv>
+struct Pipeline
+{
+    static constexpr SortKind kind = kindv;
+    static constexpr bool icase = icasev;
+    static constexpr bool reject_noext = rejectnoextv;
+    static constexpr SinkKind sink = sinkv;
 };
 
+// same idea as Pipeline, for the options the walkers (and CountFiles::acceptEntry()) check
+template<bool onlyv, bool icasev, bool newerv, bool uniquev>
+struct WalkFlags
+{
+    static constexpr bool only = onlyv;
+    // only matters to '--only'; the tallies fold case through Pipeline
+    static constexpr bool icase = icasev;
+    static constexpr bool newer = newerv;
+    static constexpr bool unique = uniquev;
+};
+
+// '--only' is limited to this many extensions, which keeps its lookup table tiny
+using OnlySet = PerfectHash<64, 256>;
+
 struct Config
 {
     // what to sort for - default is SortKind::Extension, i.e., file extensions.
-    SortKind sortkind = SortKind::Extension;
+    // several modes are all counted during the same walk; handled by '-m'
+    std::vector<SortKind> sortkinds = {SortKind::Extension};
 
     // whether to store file extension case-insensitively
     bool icase = false;
@@ -72,14 +157,102 @@ struct Config
 
     bool collectonly = false;
 
+    // like collectonly, but keys are printed as soon as they're first seen,
+    // instead of after the walk; handled by '--stream'
+    bool streamcollect = false;
+
     bool verbose = false;
 
     size_t maxdepth = 0;
 
+    // if non-zero, only keep this many counters (see SpaceSaving), and print
+    // per-key error bounds. memory stays fixed regardless of how many keys there are.
+    size_t approxcount = 0;
+
+    // whether to only estimate the amount of distinct keys (see HyperLogLog),
+    // instead of listing them.
+    bool cardinality = false;
+
+    // sketches from earlier runs to merge into the estimate; handled by '--sketch-load'
+    std::vector<std::string> sketchload = {};
+
+    // where to save the sketch to, so later runs can merge it; handled by '--sketch-save'
+    std::string sketchsave;
+
     // where the output is written to. default is std::cout; handled by '-o' flag
     std::ostream* outstream;
 
     std::vector<std::filesystem::path> pruneme = {};
+
+    // if not empty, only files with these extensions are counted; handled by '--only'
+    std::vector<std::string> onlyexts = {};
+
+    // amount of threads walking directories. anything above 1 uses DirWalker
+    // instead of Find::Finder; handled by '-j'
+    size_t jobs = 1;
+
+    // whether to pick the amount of threads by storage type, and adjust it while walking;
+    // 'jobs' is then the upper bound. handled by '-j auto'
+    bool autojobs = false;
+
+    // whether to descend into symlinked directories (also uses DirWalker); handled by '--follow'
+    bool follow = false;
+
+    // whether to stay on the filesystem of each root (also uses DirWalker); handled by '--one-file-system'
+    bool onefs = false;
+
+    // whether each device gets its own '--jobs' workers, so all of them are busy at once
+    // (also uses DirWalker); handled by '--per-device'
+    bool perdevice = false;
+
+    // whether each directory's entries are visited in inode order when their metadata is needed,
+    // which keeps a spinning disk's head from jumping around (also uses DirWalker); handled by '--inode-order'
+    bool inodeorder = false;
+
+    // how many subtrees '--mode=rollup' prints; handled by '--top'
+    size_t topcount = 20;
+
+    // print tables ('--mode=depth', '--mode=age') as JSON; handled by '--json'
+    bool jsonoutput = false;
+
+    // when the walk started, in nanoseconds since the epoch. what '--mode=age' is relative to
+    int64_t starttime = 0;
+
+    // if set, only files modified after this (in nanoseconds since the epoch) are counted; handled by '--newer'
+    bool havenewer = false;
+    int64_t newerthan = 0;
+
+    // whether to count files with several hard links only once; handled by '--unique-inodes'
+    bool uniqueinodes = false;
+
+    // whether '--mode=size' also prints the full size histogram of every key; handled by '--histogram'
+    bool printhistogram = false;
+
+    // if set, directory listings are taken from (and saved to) this file, so unchanged
+    // directories needn't be read again (also uses DirWalker); handled by '--cache'
+    std::string cachefile;
+
+    // whether to run at idle i/o and cpu priority; handled by '--gentle'
+    bool gentle = false;
+
+    // if not 0, at most this many directories are read per second; handled by '--max-rate' (and '--gentle')
+    double maxrate = 0;
+
+    // whether to keep counting changes after the walk, printing every 'watchinterval' seconds
+    // (if not 0) and on SIGUSR1, until SIGINT or SIGTERM (also uses DirWalker); handled by '--watch'
+    bool watch = false;
+    double watchinterval = 0;
+
+    // if not 0, what's been counted so far is printed every this many seconds while walking; handled by '--emit-every'
+    double emitevery = 0;
+
+    // if set, the walk is saved to this file every 'checkpointevery' seconds (also uses DirWalker),
+    // and removed once it's done; handled by '--checkpoint' and '--checkpoint-every'
+    std::string checkpointfile;
+    double checkpointevery = 60;
+
+    // if set, the walk continues from this checkpoint file; handled by '--resume'
+    std::string resumefile;
 };
 
 class ExtList
@@ -93,6 +266,9 @@ class ExtList
             std::string ext;
             size_t count;
             size_t hash;
+            // sum of file sizes, and how they're distributed; only used by SortKind::Size
+            uint64_t size = 0;
+            SizeHistogram hist = {};
         };
 
     private:
@@ -144,319 +320,3462 @@ class ExtList
             return false;
         }
 
-        void increase(const std::string& ext)
+        // appends $ext (which must not be in the list yet) with an initial count, and returns its index
+        size_t insert(const std::string& ext, size_t count)
         {
-            size_t idx;
             size_t hash;
             hash = m_hashfn(ext);
-            if(contains(hash, idx))
-            {
-                m_items[idx].count++;
-            }
-            else
-            {
-                m_seen.push_back(hash);
-                m_items.push_back(Item{ext, 1, hash});
-            }
+            m_seen.push_back(hash);
+            m_items.push_back(Item{ext, count, hash});
+            return (m_items.size() - 1);
         }
-};
-
-class CountFiles
-{
-    private:
-        ExtList m_map;
-        Config& m_options;
-        size_t m_padding = 5;
 
-    private:
-        void checkPadding(size_t slen)
+        Item& at(size_t idx)
         {
-            if(slen > m_padding)
-            {
-                m_padding = slen;
-            }
+            return m_items[idx];
         }
 
-        // this function will attempt to remove '\r\n'.
-        // this only applies to listing files.
-        // it will effectively do nothing if the string does not contain a '\r'
-        void fixCR(std::string& str)
+        // the item for $ext, appended with a count of 0 if it's new
+        Item& get(const std::string& ext)
         {
-            if(!str.empty() && (str[str.size() - 1] == '\r'))
+            size_t idx;
+            size_t hash;
+            hash = m_hashfn(ext);
+            if(contains(hash, idx))
             {
-                str.erase(str.size() - 1);
+                return m_items[idx];
             }
+            m_seen.push_back(hash);
+            m_items.push_back(Item{ext, 0, hash});
+            return m_items.back();
         }
 
-        void shortenpath(std::string& rawpath)
+        void add(const std::string& ext, size_t count, uint64_t size)
         {
-            size_t plen;
-            while(true)
-            {
-                plen = rawpath.size();
-                rawpath = rawpath.substr(10, plen);
-                if(rawpath.size() < CFILES_MAXPATHLEN)
-                {
-                    break;
-                }
-            }
+            auto& item = get(ext);
+            item.count += count;
+            item.size += size;
         }
 
-        void push(const std::string& val)
+        void increase(const std::string& ext)
         {
-            m_map.increase(val);
+            add(ext, 1, 0);
         }
 
-    public:
-        CountFiles(Config& opts): m_options(opts)
+        // for SortKind::Size
+        void increaseSized(const std::string& ext, uint64_t size)
         {
+            auto& item = get(ext);
+            item.count++;
+            item.size += size;
+            item.hist.add(size);
         }
 
-        std::ostream& out()
+        void merge(const Item& other)
         {
-            return *(m_options.outstream);
+            auto& item = get(other.ext);
+            item.count += other.count;
+            item.size += other.size;
+            item.hist.merge(other.hist);
         }
 
-        template<typename... Args>
-        void verbose(const char* fmt, Args&&... args)
+        // for '--checkpoint'. items stay in the order they were first seen in, and histograms only keep their non-empty buckets
+        void writeTo(std::ostream& os) const
         {
-            if(m_options.verbose)
+            size_t b;
+            uint64_t nbuckets;
+            BinIO::writeVal(os, uint64_t(m_items.size()));
+            for(const auto& item: m_items)
             {
-                std::fprintf(stderr, "[v] ");
-                std::fprintf(stderr, fmt, args...);
-                std::fprintf(stderr, "\n");
+                BinIO::writeString(os, item.ext);
+                BinIO::writeVal(os, uint64_t(item.count));
+                BinIO::writeVal(os, item.size);
+                nbuckets = 0;
+                for(b=0; b<SizeHistogram::bucketcount; b++)
+                {
+                    nbuckets += ((item.hist.at(b) > 0) ? 1 : 0);
+                }
+                BinIO::writeVal(os, nbuckets);
+                for(b=0; b<SizeHistogram::bucketcount; b++)
+                {
+                    if(item.hist.at(b) > 0)
+                    {
+                        BinIO::writeVal(os, uint8_t(b));
+                        BinIO::writeVal(os, item.hist.at(b));
+                    }
+                }
             }
         }
 
-        // this function is where post-processing (like turning strings lowercase)
-        // happens. new options and/or functionality that directly operate
-        // on the input string should be added here.
-        void increase(const std::string& val)
+        bool readFrom(std::istream& is)
         {
-            std::string copy;
-            checkPadding(val.size());
-            if(m_options.icase)
-            {
-                copy = val;
-                std::transform(copy.begin(), copy.end(), copy.begin(), ::tolower);
-                push(copy);
-            }
-            else
+            uint8_t b;
+            uint64_t bcount;
+            uint64_t count;
+            uint64_t nitems;
+            uint64_t nbuckets;
+            if(!BinIO::readVal(is, nitems))
             {
-                push(val);
+                return false;
             }
-        }
-
-        void modeExtension(const std::filesystem::path& item)
-        {
-            std::string strext;
-            std::string bnamestr;
-            std::filesystem::path bname;
-            bname = item.filename();
-            bnamestr = bname.string();
-            /*
-            * if the item path is something like "foo/bar/", then
-            * bname is just an empty string, and doesn't contain anything to work with.
-            * theoretically, this shouldn't happen, though.
-            */
-            if(!bnamestr.empty())
+            while(nitems-- > 0)
             {
-                strext = bname.extension().string();
-                /*
-                * in some super funky cases, the extension might be something
-                * like "." (i.e., "foo."). i don't who or why someone would
-                * name a file like this, but still.
-                */
-                if(strext.size() > 1)
+                Item item;
+                if(!BinIO::readString(is, item.ext) || !BinIO::readVal(is, count) || !BinIO::readVal(is, item.size) || !BinIO::readVal(is, nbuckets) || (nbuckets > SizeHistogram::bucketcount))
                 {
-                    increase(strext);
+                    return false;
                 }
-                else
+                item.count = count;
+                while(nbuckets-- > 0)
                 {
-                    if(!m_options.reject_noext)
+                    if(!BinIO::readVal(is, b) || !BinIO::readVal(is, bcount) || (b >= SizeHistogram::bucketcount))
                     {
-                        increase(bname.string());
+                        return false;
                     }
+                    item.hist.addBucket(b, bcount);
                 }
+                merge(item);
             }
+            return true;
         }
+};
 
-        void modeStem(const std::filesystem::path& item)
-        {
-            std::string stemstr;
-            std::filesystem::path stem;
-            stem = item.stem();
-            stemstr = stem.string();
-            increase(stemstr);
-        }
+/*
+* fixed counters for keys that are known ahead of time (see knownext.h).
+* a key only gets an entry in the ExtList the first time it is seen - which keeps the order
+* intact for unsorted output - and its count is moved over by flush().
+*/
+template<size_t slotcount>
+class SlotList
+{
+    public:
+        static constexpr size_t npos = size_t(-1);
 
-        /*
-        void modeFilesize(const std::filesystem::path& item)
+    private:
+        std::array<size_t, slotcount> m_counts = {};
+        // where each slot sits in the ExtList, once it has been seen
+        std::array<size_t, slotcount> m_listidx;
+
+    public:
+        SlotList()
         {
-            
+            m_listidx.fill(npos);
         }
-        */
 
-        void handleItem(const std::filesystem::path& item)
+        // returns true if this is the first time $slot is seen
+        bool add(size_t slot, std::string_view key, size_t count, ExtList& list)
         {
-            switch(m_options.sortkind)
+            bool isnew;
+            isnew = (m_listidx[slot] == npos);
+            if(isnew)
             {
-                case SortKind::Extension:
-                    return modeExtension(item);
-                case SortKind::Stem:
-                    return modeStem(item);
-                /*
-                case SortKind::Filesize:
-                    return modeFilesize(item);
-                */
-                default:
-                    std::cerr << "unimplemented sort kind" << std::endl;
-                    std::exit(1);
-                    break;
+                m_listidx[slot] = list.insert(std::string(key), 0);
             }
+            m_counts[slot] += count;
+            return isnew;
         }
 
-        void walkFilestream(std::istream& infh)
+        bool increase(size_t slot, std::string_view key, ExtList& list)
         {
-            std::string line;
-            while(std::getline(infh, line))
-            {
-                fixCR(line);
-                if(line.size() >= CFILES_MAXPATHLEN)
-                {
-                    shortenpath(line);
-                }
-                //std::cerr << "line=" << line << '\n';
-                try
-                {
-                    handleItem(line);
-                }
-                catch(std::exception& ex)
-                {
-                    std::cerr << "in walkFilestream: " << ex.what() << "(line: \"" << line << "\")" << std::endl;
-                }
-            }
+            return add(slot, key, 1, list);
         }
 
-        void walkDirectory(const std::string& dir)
+        void flush(ExtList& list)
         {
-            Find::Finder fi(dir);
-            fi.setMaxDepth(m_options.maxdepth);
-            fi.onException([&](const std::exception& ex, const std::string& orig, const std::filesystem::path& p)
-            {
-                std::string exmsg;
-                exmsg = ex.what();
-                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\r'), exmsg.end());
-                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\n'), exmsg.end());
-                std::cerr << "ERROR: in '" << orig << "': path \"" << p.string() << "\": " << exmsg << std::endl;
-            });
-            fi.skipItemIf([&](const std::filesystem::path& checkthis, bool isdir, bool isfile)
+            size_t i;
+            for(i=0; i<slotcount; i++)
             {
-                (void)isfile;
-                if(isdir)
+                if(m_listidx[i] != npos)
                 {
-                    verbose("current path: %s", checkthis.string().c_str());
+                    list.at(m_listidx[i]).count += m_counts[i];
+                    m_counts[i] = 0;
                 }
-                return (isdir);
-            });
+            }
+        }
+};
 
-            fi.pruneIf([&](const std::filesystem::path& checkthis)
-            {
-                for(auto& prunethis: m_options.pruneme)
-                {
-                    if(prunethis.empty())
-                    {
-                        continue;
-                    }
-                    //std::cerr << "checkthis.parent_path() = " << checkthis.parent_path() << std::endl;
-                    //std::cerr << "prunethis.parent_path() = " << prunethis.parent_path().string() << std::endl;
-                    // todo: add option to ignore case maybe?
-                    // first, check if the paths match as-is ...
-                    if(checkthis == prunethis)
-                    {
-                        return true;
-                    }
-                    // then, check if filename (in case of directories, the dirname) is equal ...
-                    if(checkthis.has_parent_path() && ((!prunethis.empty()) && prunethis.has_parent_path()))
-                    {
+/*
+* file counts and sizes per directory, for '--mode=rollup'.
+* while walking, only directories that directly contain files get a node - so memory
+* scales with the amount of directories, not files. rollup() then links every node to its
+* parent (creating the ones in between), and sums each level into the one above it,
+* deepest level first.
+*/
+class DirTable
+{
+    public:
+        static constexpr size_t npos = size_t(-1);
 
-                        if(checkthis.parent_path() == prunethis.parent_path())
-                        {
-                            return true;
-                        }
-                    }
-                    // lastly, do a lexical check
-                    return ((checkthis.compare(prunethis)) >= 0);
-                }
-                return false;
-            });
+        struct Node
+        {
+            std::string path;
+            // index of the parent directory, or npos for walk roots (and the top of listings)
+            size_t parent;
+            // files and bytes directly in this directory - or in the whole subtree, after rollup()
+            uint64_t files;
+            uint64_t bytes;
+        };
 
-            fi.walk([&](const std::filesystem::path& path)
-            {
-                handleItem(path);
-            });
-        }
+    private:
+        std::vector<Node> m_nodes;
+        std::unordered_map<std::string, size_t> m_index;
+        // where to stop going upwards
+        std::unordered_set<std::string> m_roots;
+        // consecutive files nearly always share a directory, so this saves most lookups
+        size_t m_lastidx = npos;
 
-        void sort()
+    private:
+        // "foo/bar/" and "foo/bar" are the same directory
+        static std::string_view trimDir(std::string_view path)
         {
-            std::sort(m_map.begin(), m_map.end(), [](const ExtList::Item& lhs, const ExtList::Item& rhs)
+            while((path.size() > 1) && (path.back() == '/'))
             {
-                return (lhs.count < rhs.count);
-            });
+                path.remove_suffix(1);
+            }
+            return path;
         }
 
-        ExtList get()
+        // empty if $path has no parent
+        static std::string_view parentDir(std::string_view path)
         {
-            return m_map;
+            size_t pos;
+            path = trimDir(path);
+            if(path == "/")
+            {
+                return {};
+            }
+            pos = path.find_last_of('/');
+            if(pos == std::string_view::npos)
+            {
+                return {};
+            }
+            if(pos == 0)
+            {
+                return "/";
+            }
+            return trimDir(path.substr(0, pos));
         }
 
-        void printVals(const std::string& ext, const size_t& count)
+        size_t nodeFor(std::string_view dirpath)
         {
-            std::stringstream buf;
-            size_t realpad;
-            if(m_options.collectonly)
-            {
-                out() << ext << '\n';
-            }
-            else
+            size_t idx;
+            std::string key(dirpath);
+            auto it = m_index.find(key);
+            if(it != m_index.end())
             {
-                realpad = (m_padding + 2);
-                out() << std::setw(realpad) << ext << " " << count << '\n';
+                return it->second;
             }
+            idx = m_nodes.size();
+            m_nodes.push_back(Node{key, npos, 0, 0});
+            m_index.emplace(std::move(key), idx);
+            return idx;
         }
 
-        void printOutput()
+        // runs fn(begin, end) over [0, count) in $threads chunks
+        template<typename FuncT>
+        static void parallelFor(size_t count, size_t threads, FuncT&& fn)
         {
-            if(m_options.sortvals && (!m_options.collectonly))
+            size_t i;
+            size_t chunk;
+            std::vector<std::thread> pool;
+            // not worth spinning up threads for small levels
+            if((threads < 2) || (count < 4096))
             {
-                sort();
+                fn(size_t(0), count);
+                return;
             }
-            if(m_options.revoutput && (!m_options.collectonly))
+            chunk = ((count + threads - 1) / threads);
+            for(i=0; i<count; i+=chunk)
             {
-                for(auto it=m_map.rbegin(); it!=m_map.rend(); it++)
+                pool.emplace_back([&fn, i, chunk, count]
                 {
-                    printVals(it->ext, it->count);
-                }
+                    fn(i, std::min(count, i + chunk));
+                });
             }
-            else
+            for(auto& th: pool)
             {
-                for(auto it=m_map.begin(); it!=m_map.end(); it++)
-                {
-                    printVals(it->ext, it->count);
-                }
+                th.join();
             }
         }
-};
 
-/*
-* for some reason, isatty() seems to not work... sometimes.
-* haven't been able to figure out why, yet.
-* works so far with msvc, clang (for msvc), and gcc.
-*/
-static bool have_filepipe()
-{
-    return (isatty(fileno(stdin)) == 0);
-}
+    public:
+        size_t size() const
+        {
+            return m_nodes.size();
+        }
+
+        const std::vector<Node>& nodes() const
+        {
+            return m_nodes;
+        }
+
+        void addRoot(std::string_view dirpath)
+        {
+            m_roots.emplace(trimDir(dirpath));
+        }
+
+        void add(std::string_view dirpath, uint64_t files, uint64_t bytes)
+        {
+            dirpath = trimDir(dirpath);
+            if((m_lastidx == npos) || (m_nodes[m_lastidx].path != dirpath))
+            {
+                m_lastidx = nodeFor(dirpath);
+            }
+            m_nodes[m_lastidx].files += files;
+            m_nodes[m_lastidx].bytes += bytes;
+        }
+
+        // only valid before rollup()
+        void merge(const DirTable& other)
+        {
+            for(const auto& root: other.m_roots)
+            {
+                m_roots.insert(root);
+            }
+            for(const auto& node: other.m_nodes)
+            {
+                add(node.path, node.files, node.bytes);
+            }
+        }
+
+        // for '--checkpoint'; only valid before rollup(). the roots aren't included, as they're given again when resuming
+        void writeTo(std::ostream& os) const
+        {
+            BinIO::writeVal(os, uint64_t(m_nodes.size()));
+            for(const auto& node: m_nodes)
+            {
+                BinIO::writeString(os, node.path);
+                BinIO::writeVal(os, node.files);
+                BinIO::writeVal(os, node.bytes);
+            }
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            uint64_t count;
+            uint64_t files;
+            uint64_t bytes;
+            std::string path;
+            if(!BinIO::readVal(is, count))
+            {
+                return false;
+            }
+            while(count-- > 0)
+            {
+                if(!BinIO::readString(is, path) || !BinIO::readVal(is, files) || !BinIO::readVal(is, bytes))
+                {
+                    return false;
+                }
+                add(path, files, bytes);
+            }
+            return true;
+        }
+
+        // turns every node's own counts into those of its whole subtree
+        void rollup(size_t threads)
+        {
+            size_t i;
+            size_t idx;
+            size_t level;
+            size_t maxdepth;
+            std::string_view parent;
+            std::vector<size_t> depths;
+            std::vector<std::vector<size_t>> levels;
+            // link parents. nodes created in here are appended, and linked in turn.
+            for(i=0; i<m_nodes.size(); i++)
+            {
+                if(m_roots.count(m_nodes[i].path) > 0)
+                {
+                    continue;
+                }
+                parent = parentDir(m_nodes[i].path);
+                if(!parent.empty())
+                {
+                    idx = nodeFor(parent);
+                    m_nodes[i].parent = idx;
+                }
+            }
+            // depth of every node, walking up until one with a known depth
+            depths.assign(m_nodes.size(), npos);
+            maxdepth = 0;
+            for(i=0; i<m_nodes.size(); i++)
+            {
+                std::vector<size_t> chain;
+                idx = i;
+                while((idx != npos) && (depths[idx] == npos))
+                {
+                    chain.push_back(idx);
+                    idx = m_nodes[idx].parent;
+                }
+                level = ((idx == npos) ? 0 : (depths[idx] + 1));
+                while(!chain.empty())
+                {
+                    depths[chain.back()] = level++;
+                    chain.pop_back();
+                }
+                maxdepth = std::max(maxdepth, depths[i]);
+            }
+            levels.resize(maxdepth + 1);
+            for(i=0; i<m_nodes.size(); i++)
+            {
+                levels[depths[i]].push_back(i);
+            }
+            // bottom-up: every level is complete before it's added to the next one up,
+            // and within a level, only parents are written to - hence atomics.
+            std::vector<std::atomic<uint64_t>> files(m_nodes.size());
+            std::vector<std::atomic<uint64_t>> bytes(m_nodes.size());
+            for(i=0; i<m_nodes.size(); i++)
+            {
+                files[i].store(m_nodes[i].files, std::memory_order_relaxed);
+                bytes[i].store(m_nodes[i].bytes, std::memory_order_relaxed);
+            }
+            for(level=maxdepth; level>0; level--)
+            {
+                auto& nodes = levels[level];
+                parallelFor(nodes.size(), threads, [&](size_t begin, size_t end)
+                {
+                    size_t j;
+                    size_t node;
+                    for(j=begin; j<end; j++)
+                    {
+                        node = nodes[j];
+                        files[m_nodes[node].parent].fetch_add(files[node].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        bytes[m_nodes[node].parent].fetch_add(bytes[node].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    }
+                });
+            }
+            for(i=0; i<m_nodes.size(); i++)
+            {
+                m_nodes[i].files = files[i].load(std::memory_order_relaxed);
+                m_nodes[i].bytes = bytes[i].load(std::memory_order_relaxed);
+            }
+            m_lastidx = npos;
+        }
+};
+
+/*
+* counts per (bucket, key) - buckets being depths for '--mode=depth', and ages for '--mode=age'.
+* every key gets a small integer id, and every bucket one dense row of counters indexed by it -
+* rows only grow to the largest id seen in their bucket, so e.g. shallow levels with few keys stay small.
+*/
+class BucketTable
+{
+    private:
+        std::vector<std::string> m_keys;
+        std::unordered_map<std::string, size_t> m_ids;
+        std::vector<std::vector<uint64_t>> m_rows;
+
+    private:
+        size_t idFor(const std::string& key)
+        {
+            size_t id;
+            auto it = m_ids.find(key);
+            if(it != m_ids.end())
+            {
+                return it->second;
+            }
+            id = m_keys.size();
+            m_keys.push_back(key);
+            m_ids.emplace(key, id);
+            return id;
+        }
+
+    public:
+        const std::vector<std::string>& keys() const
+        {
+            return m_keys;
+        }
+
+        // largest bucket seen, plus one
+        size_t bucketCount() const
+        {
+            return m_rows.size();
+        }
+
+        uint64_t at(size_t bucket, size_t id) const
+        {
+            if((bucket < m_rows.size()) && (id < m_rows[bucket].size()))
+            {
+                return m_rows[bucket][id];
+            }
+            return 0;
+        }
+
+        // sum over all buckets
+        uint64_t total(size_t id) const
+        {
+            size_t bucket;
+            uint64_t res;
+            res = 0;
+            for(bucket=0; bucket<m_rows.size(); bucket++)
+            {
+                res += at(bucket, id);
+            }
+            return res;
+        }
+
+        void add(size_t bucket, const std::string& key, uint64_t count)
+        {
+            size_t id;
+            id = idFor(key);
+            if(bucket >= m_rows.size())
+            {
+                m_rows.resize(bucket + 1);
+            }
+            auto& row = m_rows[bucket];
+            if(id >= row.size())
+            {
+                row.resize(id + 1, 0);
+            }
+            row[id] += count;
+        }
+
+        void merge(const BucketTable& other)
+        {
+            size_t id;
+            size_t bucket;
+            for(bucket=0; bucket<other.m_rows.size(); bucket++)
+            {
+                for(id=0; id<other.m_rows[bucket].size(); id++)
+                {
+                    if(other.m_rows[bucket][id] > 0)
+                    {
+                        add(bucket, other.m_keys[id], other.m_rows[bucket][id]);
+                    }
+                }
+            }
+        }
+
+        // for '--checkpoint'
+        void writeTo(std::ostream& os) const
+        {
+            BinIO::writeVal(os, uint64_t(m_keys.size()));
+            for(const auto& key: m_keys)
+            {
+                BinIO::writeString(os, key);
+            }
+            BinIO::writeVal(os, uint64_t(m_rows.size()));
+            for(const auto& row: m_rows)
+            {
+                BinIO::writeVal(os, uint64_t(row.size()));
+                for(auto count: row)
+                {
+                    BinIO::writeVal(os, count);
+                }
+            }
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            uint64_t id;
+            uint64_t bucket;
+            uint64_t nkeys;
+            uint64_t nrows;
+            uint64_t rowsize;
+            uint64_t count;
+            std::string key;
+            std::vector<std::string> keys;
+            if(!BinIO::readVal(is, nkeys))
+            {
+                return false;
+            }
+            while(nkeys-- > 0)
+            {
+                if(!BinIO::readString(is, key))
+                {
+                    return false;
+                }
+                // ids in the order they were handed out at first
+                idFor(key);
+                keys.push_back(key);
+            }
+            if(!BinIO::readVal(is, nrows))
+            {
+                return false;
+            }
+            for(bucket=0; bucket<nrows; bucket++)
+            {
+                if(!BinIO::readVal(is, rowsize) || (rowsize > keys.size()))
+                {
+                    return false;
+                }
+                for(id=0; id<rowsize; id++)
+                {
+                    if(!BinIO::readVal(is, count))
+                    {
+                        return false;
+                    }
+                    if(count > 0)
+                    {
+                        add(bucket, keys[id], count);
+                    }
+                }
+            }
+            return true;
+        }
+};
+
+/*
+* the (device, inode) pairs seen so far, for '--unique-inodes'.
+* one open-addressing table of inode numbers per device - 8 bytes a slot, at most 70% full -
+* which takes a fraction of what a node-based set would. it's split into shards with a lock
+* each, since with '--jobs', the links to one file may well be found by different workers.
+*/
+class InodeSet
+{
+    private:
+        static constexpr size_t shardcount = 16;
+
+        struct Table
+        {
+            // 0 marks an empty slot; inode 0 is tracked by `havezero` instead
+            std::vector<uint64_t> slots;
+            size_t count = 0;
+            bool havezero = false;
+        };
+
+        struct Shard
+        {
+            std::mutex lock;
+            std::unordered_map<uint64_t, Table> devices;
+        };
+
+    private:
+        std::array<Shard, shardcount> m_shards;
+
+    private:
+        static uint64_t mix(uint64_t h)
+        {
+            h ^= (h >> 33);
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= (h >> 33);
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= (h >> 33);
+            return h;
+        }
+
+        // assumes $ino isn't in there yet, and that there's room
+        static void place(std::vector<uint64_t>& slots, uint64_t ino)
+        {
+            size_t pos;
+            pos = (mix(ino) & (slots.size() - 1));
+            while(slots[pos] != 0)
+            {
+                pos = ((pos + 1) & (slots.size() - 1));
+            }
+            slots[pos] = ino;
+        }
+
+        static void grow(Table& table)
+        {
+            std::vector<uint64_t> old;
+            old.swap(table.slots);
+            table.slots.assign(std::max(size_t(1024), old.size() * 2), 0);
+            for(auto ino: old)
+            {
+                if(ino != 0)
+                {
+                    place(table.slots, ino);
+                }
+            }
+        }
+
+        static bool insertInto(Table& table, uint64_t ino)
+        {
+            size_t pos;
+            if(ino == 0)
+            {
+                if(table.havezero)
+                {
+                    return false;
+                }
+                table.havezero = true;
+                return true;
+            }
+            if(((table.count + 1) * 10) > (table.slots.size() * 7))
+            {
+                grow(table);
+            }
+            pos = (mix(ino) & (table.slots.size() - 1));
+            while(table.slots[pos] != 0)
+            {
+                if(table.slots[pos] == ino)
+                {
+                    return false;
+                }
+                pos = ((pos + 1) & (table.slots.size() - 1));
+            }
+            table.slots[pos] = ino;
+            table.count++;
+            return true;
+        }
+
+    public:
+        // true if ($dev, $ino) hasn't been seen before
+        bool insert(uint64_t dev, uint64_t ino)
+        {
+            auto& shard = m_shards[mix(ino ^ dev) % shardcount];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            return insertInto(shard.devices[dev], ino);
+        }
+
+        // for '--checkpoint': every (dev, ino) pair, per shard
+        void writeTo(std::ostream& os)
+        {
+            uint64_t count;
+            for(auto& shard: m_shards)
+            {
+                std::lock_guard<std::mutex> guard(shard.lock);
+                count = 0;
+                for(const auto& it: shard.devices)
+                {
+                    count += (it.second.count + (it.second.havezero ? 1 : 0));
+                }
+                BinIO::writeVal(os, count);
+                for(const auto& it: shard.devices)
+                {
+                    if(it.second.havezero)
+                    {
+                        BinIO::writeVal(os, it.first);
+                        BinIO::writeVal(os, uint64_t(0));
+                    }
+                    for(auto ino: it.second.slots)
+                    {
+                        if(ino != 0)
+                        {
+                            BinIO::writeVal(os, it.first);
+                            BinIO::writeVal(os, ino);
+                        }
+                    }
+                }
+            }
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            size_t i;
+            uint64_t dev;
+            uint64_t ino;
+            uint64_t count;
+            for(i=0; i<shardcount; i++)
+            {
+                if(!BinIO::readVal(is, count))
+                {
+                    return false;
+                }
+                while(count-- > 0)
+                {
+                    if(!BinIO::readVal(is, dev) || !BinIO::readVal(is, ino))
+                    {
+                        return false;
+                    }
+                    insert(dev, ino);
+                }
+            }
+            return true;
+        }
+};
+
+/*
+* a token bucket, for '--max-rate': tokens come in at $rate per second, up to a tenth of a
+* second's worth, and every take() uses one. when there's none left, the caller reserves
+* the next one anyway (so the count goes below zero), and sleeps until it would have arrived -
+* which keeps callers from several threads in line without having to wake each other up.
+*/
+class TokenBucket
+{
+    private:
+        std::mutex m_lock;
+        double m_rate = 0;
+        double m_burst = 0;
+        double m_tokens = 0;
+        std::chrono::steady_clock::time_point m_last;
+
+    public:
+        void setRate(double rate)
+        {
+            m_rate = rate;
+            m_burst = std::max(1.0, (rate / 10.0));
+            m_tokens = m_burst;
+            m_last = std::chrono::steady_clock::now();
+        }
+
+        bool enabled() const
+        {
+            return (m_rate > 0);
+        }
+
+        // blocks until the caller may go ahead
+        void take()
+        {
+            double wait;
+            if(m_rate <= 0)
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                auto now = std::chrono::steady_clock::now();
+                m_tokens = std::min(m_burst, m_tokens + (std::chrono::duration<double>(now - m_last).count() * m_rate));
+                m_last = now;
+                m_tokens -= 1;
+                if(m_tokens >= 0)
+                {
+                    return;
+                }
+                wait = (-m_tokens / m_rate);
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+};
+
+template<typename... Args>
+static void verboseMsg(const Config& opts, const char* fmt, Args&&... args)
+{
+    if(opts.verbose)
+    {
+        std::fprintf(stderr, "[v] ");
+        std::fprintf(stderr, fmt, args...);
+        std::fprintf(stderr, "\n");
+    }
+}
+
+static const char* sortKindName(SortKind kind)
+{
+    switch(kind)
+    {
+        case SortKind::Extension:
+            return "extension";
+        case SortKind::Stem:
+            return "stem";
+        case SortKind::Filename:
+            return "filename";
+        case SortKind::Language:
+            return "language";
+        case SortKind::Size:
+            return "size";
+        case SortKind::Rollup:
+            return "rollup";
+        case SortKind::Depth:
+            return "depth";
+        case SortKind::Age:
+            return "age";
+        case SortKind::Owner:
+            return "owner";
+    }
+    return "unknown";
+}
+
+static void printJsonString(std::ostream& os, std::string_view str)
+{
+    char buf[8];
+    os << '"';
+    for(auto ch: str)
+    {
+        if((ch == '"') || (ch == '\\'))
+        {
+            os << '\\' << ch;
+        }
+        else if(uint8_t(ch) < 0x20)
+        {
+            std::snprintf(buf, sizeof(buf), "\\u%04x", int(ch));
+            os << buf;
+        }
+        else
+        {
+            os << ch;
+        }
+    }
+    os << '"';
+}
+
+// the columns of '--mode=age'
+static const char* agenames[] = {"day", "week", "month", "year", "older"};
+
+// index into agenames for a file last modified $age nanoseconds ago
+static size_t ageBucket(int64_t age)
+{
+    static constexpr int64_t day = (int64_t(86400) * 1000000000);
+    if(age < day)
+    {
+        return 0;
+    }
+    if(age < (7 * day))
+    {
+        return 1;
+    }
+    if(age < (30 * day))
+    {
+        return 2;
+    }
+    if(age < (365 * day))
+    {
+        return 3;
+    }
+    return 4;
+}
+
+/*
+* the amount of path separators in $path, with runs of them counted once.
+* a file directly inside "foo/" is one deeper than the "foo/" itself.
+*/
+static size_t separatorCount(std::string_view path)
+{
+    bool prevsep;
+    size_t res;
+    res = 0;
+    prevsep = false;
+    for(auto ch: path)
+    {
+        #if defined(COE_ISWINDOWS)
+            if((ch == '/') || (ch == '\\'))
+        #else
+            if(ch == '/')
+        #endif
+        {
+            if(!prevsep)
+            {
+                res++;
+            }
+            prevsep = true;
+        }
+        else
+        {
+            prevsep = false;
+        }
+    }
+    return res;
+}
+
+/*
+* uid -> user name, for '--mode=owner'. only used while printing, so each uid
+* is looked up once, no matter how many files it owns.
+*/
+class UserNames
+{
+    private:
+        std::unordered_map<uint32_t, std::string> m_names;
+
+    public:
+        // the numeric uid, if there's no such user
+        const std::string& nameOf(uint32_t uid)
+        {
+            auto it = m_names.find(uid);
+            if(it != m_names.end())
+            {
+                return it->second;
+            }
+            std::string name;
+            #if defined(COE_ISUNIXLIKE)
+                struct passwd* pw;
+                pw = getpwuid(uid);
+                if((pw != nullptr) && (pw->pw_name != nullptr))
+                {
+                    name = pw->pw_name;
+                }
+            #endif
+            if(name.empty())
+            {
+                name = std::to_string(uid);
+            }
+            return m_names.emplace(uid, std::move(name)).first->second;
+        }
+};
+
+// metadata that Entry can fetch; see Entry::want()
+enum MetaField: unsigned
+{
+    MetaSize = (1 << 0),
+    MetaMtime = (1 << 1),
+    MetaOwner = (1 << 2),
+    // device, inode, and link count
+    MetaInode = (1 << 3),
+};
+
+/*
+* a single file, as handed from the walkers to the tallies.
+* metadata is only fetched once some tally actually asks for it, and then only once,
+* no matter how many tallies ask.
+*/
+class Entry
+{
+    private:
+        const std::filesystem::path& m_path;
+        // the directory this entry is in, if the walker knows it; see dir()
+        const std::string* m_dirpath = nullptr;
+        std::string m_dirbuf;
+        // DirWalker hands out the fd of the directory, so metadata doesn't need a path lookup
+        int m_dirfd = -1;
+        const char* m_name = nullptr;
+        // depth below the walk root; see depth()
+        size_t m_depth = size_t(-1);
+        size_t m_basedepth = 0;
+        // MetaField bits: what to fetch with the first metadata call, and what has been fetched
+        unsigned m_wanted = 0;
+        unsigned m_have = 0;
+        uint64_t m_size = 0;
+        // nanoseconds since the epoch
+        int64_t m_mtime = 0;
+        uint32_t m_uid = 0;
+        uint64_t m_dev = 0;
+        uint64_t m_ino = 0;
+        uint64_t m_nlink = 1;
+
+    private:
+        /*
+        * fetches $fields, along with everything else that's wanted, in a single call.
+        * with statx, only what's asked for is requested - which, on some filesystems,
+        * saves the kernel from having to gather the rest.
+        */
+        void fetch(unsigned fields)
+        {
+            fields = ((fields | m_wanted) & ~m_have);
+            m_have |= fields;
+            #if defined(CFILES_HAVE_STATX)
+                struct statx stx;
+                unsigned mask;
+                mask = 0;
+                if(fields & MetaSize)
+                {
+                    mask |= STATX_SIZE;
+                }
+                if(fields & MetaMtime)
+                {
+                    mask |= STATX_MTIME;
+                }
+                if(fields & MetaOwner)
+                {
+                    mask |= STATX_UID;
+                }
+                if(fields & MetaInode)
+                {
+                    // the device is always filled in
+                    mask |= (STATX_INO | STATX_NLINK);
+                }
+                if(statxAt(mask, &stx))
+                {
+                    if(stx.stx_mask & STATX_SIZE)
+                    {
+                        m_size = stx.stx_size;
+                    }
+                    if(stx.stx_mask & STATX_MTIME)
+                    {
+                        m_mtime = ((int64_t(stx.stx_mtime.tv_sec) * 1000000000) + stx.stx_mtime.tv_nsec);
+                    }
+                    if(stx.stx_mask & STATX_UID)
+                    {
+                        m_uid = stx.stx_uid;
+                    }
+                    if(stx.stx_mask & STATX_INO)
+                    {
+                        m_dev = ((uint64_t(stx.stx_dev_major) << 32) | stx.stx_dev_minor);
+                        m_ino = stx.stx_ino;
+                    }
+                    if(stx.stx_mask & STATX_NLINK)
+                    {
+                        m_nlink = stx.stx_nlink;
+                    }
+                }
+            #elif defined(COE_ISUNIXLIKE)
+                struct stat st;
+                int rc;
+                if(m_dirfd != -1)
+                {
+                    rc = fstatat(m_dirfd, m_name, &st, 0);
+                }
+                else
+                {
+                    rc = stat(m_path.c_str(), &st);
+                }
+                if(rc == 0)
+                {
+                    m_size = st.st_size;
+                    m_mtime = (int64_t(st.st_mtime) * 1000000000);
+                    m_uid = st.st_uid;
+                    m_dev = st.st_dev;
+                    m_ino = st.st_ino;
+                    m_nlink = st.st_nlink;
+                }
+            #else
+                std::error_code ec;
+                if(fields & MetaSize)
+                {
+                    m_size = std::filesystem::file_size(m_path, ec);
+                    if(ec)
+                    {
+                        m_size = 0;
+                    }
+                }
+                if(fields & MetaMtime)
+                {
+                    auto ftime = std::filesystem::last_write_time(m_path, ec);
+                    if(!ec)
+                    {
+                        // c++17 has no clock_cast, so this goes through both clocks' now()
+                        auto systime = std::chrono::time_point_cast<std::chrono::nanoseconds>(
+                            ftime - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now());
+                        m_mtime = systime.time_since_epoch().count();
+                    }
+                }
+            #endif
+        }
+
+        #if defined(CFILES_HAVE_STATX)
+        bool statxAt(unsigned mask, struct statx* stx)
+        {
+            if(m_dirfd != -1)
+            {
+                return (statx(m_dirfd, m_name, 0, mask, stx) == 0);
+            }
+            return (statx(AT_FDCWD, m_path.c_str(), 0, mask, stx) == 0);
+        }
+        #endif
+
+    public:
+        Entry(const std::filesystem::path& path): m_path(path)
+        {
+        }
+
+        Entry(const std::filesystem::path& path, const std::string& dirpath, int dirfd, const char* name, size_t depth):
+            m_path(path), m_dirpath(&dirpath), m_dirfd(dirfd), m_name(name), m_depth(depth)
+        {
+        }
+
+        // separatorCount() of the walk root (plus a trailing separator), for depth()
+        void setBaseDepth(size_t depth)
+        {
+            m_basedepth = depth;
+        }
+
+        // 0 for files directly inside the walk root
+        size_t depth()
+        {
+            size_t count;
+            if(m_depth == size_t(-1))
+            {
+                if constexpr(std::is_same_v<std::filesystem::path::value_type, char>)
+                {
+                    count = separatorCount(m_path.native());
+                }
+                else
+                {
+                    count = separatorCount(m_path.string());
+                }
+                m_depth = ((count > m_basedepth) ? (count - m_basedepth) : 0);
+            }
+            return m_depth;
+        }
+
+        const std::filesystem::path& path() const
+        {
+            return m_path;
+        }
+
+        const std::string& dir()
+        {
+            if(m_dirpath == nullptr)
+            {
+                m_dirbuf = m_path.parent_path().string();
+                m_dirpath = &m_dirbuf;
+            }
+            return *m_dirpath;
+        }
+
+        // MetaField bits that the first call to size(), mtime(), etc. should fetch as well
+        void want(unsigned fields)
+        {
+            m_wanted |= fields;
+        }
+
+        // size in bytes, or 0 if it can't be determined (vanished files, broken links, ...)
+        uint64_t size()
+        {
+            if(!(m_have & MetaSize))
+            {
+                fetch(MetaSize);
+            }
+            return m_size;
+        }
+
+        // modification time in nanoseconds since the epoch, or 0 if it can't be determined
+        int64_t mtime()
+        {
+            if(!(m_have & MetaMtime))
+            {
+                fetch(MetaMtime);
+            }
+            return m_mtime;
+        }
+
+        // owning user; always 0 where there's no such thing
+        uint32_t uid()
+        {
+            if(!(m_have & MetaOwner))
+            {
+                fetch(MetaOwner);
+            }
+            return m_uid;
+        }
+
+        // dev(), ino() and nlink() are only meaningful on unix-like platforms; elsewhere,
+        // every file looks like it has just the one link
+        uint64_t dev()
+        {
+            if(!(m_have & MetaInode))
+            {
+                fetch(MetaInode);
+            }
+            return m_dev;
+        }
+
+        uint64_t ino()
+        {
+            if(!(m_have & MetaInode))
+            {
+                fetch(MetaInode);
+            }
+            return m_ino;
+        }
+
+        uint64_t nlink()
+        {
+            if(!(m_have & MetaInode))
+            {
+                fetch(MetaInode);
+            }
+            return m_nlink;
+        }
+};
+
+/*
+* the result of one mode: extracts a key from every entry, and counts it.
+* with several modes ('--mode=e,s,size'), every entry of the one walk is handed to each tally.
+*/
+class Tally
+{
+    public:
+        using HandlerFunc = void (Tally::*)(Entry&);
+
+        // keys printed so far by '--stream', shared by all workers of a parallel walk
+        struct StreamState
+        {
+            std::mutex lock;
+            std::unordered_set<std::string> seen;
+        };
+
+    private:
+        Config& m_options;
+        SortKind m_kind;
+        ExtList m_map;
+        SpaceSaving m_toplist;
+        HyperLogLog m_sketch;
+        size_t m_padding = 5;
+        // scratch space for case folding, reused for every key
+        std::string m_foldbuf;
+        // counters for extensions in knownextlist. these skip m_map entirely, until flushSlots()
+        SlotList<knownextcount> m_knownslots;
+        // counters for '--mode=language'
+        SlotList<languagecount> m_langslots;
+        // keys seen so far with '--stream'
+        std::unordered_set<std::string> m_streamseen;
+        // only set while walking in parallel; see worker()
+        std::shared_ptr<StreamState> m_streamshared;
+        // for '--mode=rollup'
+        DirTable m_dirs;
+        // for '--mode=depth'
+        BucketTable m_depths;
+        // for '--mode=age'
+        BucketTable m_ages;
+        // for '--mode=owner': one list per uid, and the one that was used last
+        std::unordered_map<uint32_t, ExtList> m_owners;
+        ExtList* m_ownerlist = nullptr;
+        uint32_t m_owneruid = 0;
+        // handleItem(), specialized for the current options; see handle()
+        HandlerFunc m_handler;
+
+    private:
+        void checkPadding(size_t slen)
+        {
+            if(slen > m_padding)
+            {
+                m_padding = slen;
+            }
+        }
+
+        template<typename PipeT>
+        void push(const std::string& val, Entry& entry)
+        {
+            if constexpr(PipeT::kind == SortKind::Size)
+            {
+                m_map.increaseSized(val, entry.size());
+            }
+            else if constexpr(PipeT::kind == SortKind::Depth)
+            {
+                m_depths.add(entry.depth(), val, 1);
+            }
+            else if constexpr(PipeT::kind == SortKind::Age)
+            {
+                m_ages.add(ageBucket(m_options.starttime - entry.mtime()), val, 1);
+            }
+            else if constexpr(PipeT::kind == SortKind::Owner)
+            {
+                ownerList(entry.uid()).add(val, 1, entry.size());
+            }
+            else if constexpr(PipeT::sink == SinkKind::Cardinality)
+            {
+                m_sketch.add(val);
+            }
+            else if constexpr(PipeT::sink == SinkKind::Stream)
+            {
+                // only copied into the set when it's new
+                if(m_streamseen.find(val) == m_streamseen.end())
+                {
+                    m_streamseen.emplace(val);
+                    streamKey(val);
+                }
+            }
+            else if constexpr(PipeT::sink == SinkKind::Approx)
+            {
+                m_toplist.increase(val);
+            }
+            else
+            {
+                if constexpr(PipeT::kind == SortKind::Extension)
+                {
+                    int known;
+                    known = knownexts.find(val);
+                    if(known >= 0)
+                    {
+                        m_knownslots.increase(known, val, m_map);
+                        return;
+                    }
+                }
+                m_map.increase(val);
+            }
+        }
+
+        // files of one user tend to come in long runs, so this mostly skips the lookup
+        ExtList& ownerList(uint32_t uid)
+        {
+            if((m_ownerlist == nullptr) || (uid != m_owneruid))
+            {
+                m_ownerlist = &m_owners[uid];
+                m_owneruid = uid;
+            }
+            return *m_ownerlist;
+        }
+
+        // moves the counts of fixed slots into m_map
+        void flushSlots()
+        {
+            m_knownslots.flush(m_map);
+            m_langslots.flush(m_map);
+        }
+
+        template<SortKind kind, bool icase, bool rejectnoext, typename FuncT>
+        void withSink(FuncT&& fn)
+        {
+            // sizes need the exact list, and rollups and depths have their own
+            if constexpr((kind == SortKind::Size) || (kind == SortKind::Rollup) || (kind == SortKind::Depth) || (kind == SortKind::Age) || (kind == SortKind::Owner))
+            {
+                return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Exact>{});
+            }
+            // languages always go into m_langslots, which can also tell if they're new
+            if constexpr(kind == SortKind::Language)
+            {
+                if(sinkKind() == SinkKind::Stream)
+                {
+                    return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Stream>{});
+                }
+                return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Exact>{});
+            }
+            switch(sinkKind())
+            {
+                case SinkKind::Stream:
+                    return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Stream>{});
+                case SinkKind::Cardinality:
+                    return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Cardinality>{});
+                case SinkKind::Approx:
+                    return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Approx>{});
+                case SinkKind::Exact:
+                    return fn(Pipeline<kind, icase, rejectnoext, SinkKind::Exact>{});
+            }
+        }
+
+        template<SortKind kind, bool icase, typename FuncT>
+        void withRejectNoext(FuncT&& fn)
+        {
+            // only modes keyed by extension care, so don't instantiate the others twice
+            if constexpr((kind == SortKind::Extension) || (kind == SortKind::Size) || (kind == SortKind::Depth) || (kind == SortKind::Age) || (kind == SortKind::Owner))
+            {
+                if(m_options.reject_noext)
+                {
+                    return withSink<kind, icase, true>(fn);
+                }
+            }
+            return withSink<kind, icase, false>(fn);
+        }
+
+        template<SortKind kind, typename FuncT>
+        void withCase(FuncT&& fn)
+        {
+            if(m_options.icase)
+            {
+                return withRejectNoext<kind, true>(fn);
+            }
+            return withRejectNoext<kind, false>(fn);
+        }
+
+    public:
+        Tally(Config& opts, SortKind kind): m_options(opts), m_kind(kind), m_toplist(opts.approxcount)
+        {
+            withPipeline([&](auto pipe)
+            {
+                m_handler = &Tally::handleItem<decltype(pipe)>;
+            });
+        }
+
+        SortKind kind() const
+        {
+            return m_kind;
+        }
+
+        SinkKind sinkKind() const
+        {
+            if((m_kind == SortKind::Size) || (m_kind == SortKind::Rollup) || (m_kind == SortKind::Depth) || (m_kind == SortKind::Age) || (m_kind == SortKind::Owner))
+            {
+                return SinkKind::Exact;
+            }
+            if(m_options.streamcollect)
+            {
+                return SinkKind::Stream;
+            }
+            if(m_kind == SortKind::Language)
+            {
+                return SinkKind::Exact;
+            }
+            if(m_options.cardinality)
+            {
+                return SinkKind::Cardinality;
+            }
+            if(m_options.approxcount > 0)
+            {
+                return SinkKind::Approx;
+            }
+            return SinkKind::Exact;
+        }
+
+        ExtList& list()
+        {
+            return m_map;
+        }
+
+        HyperLogLog& sketch()
+        {
+            return m_sketch;
+        }
+
+        DirTable& dirs()
+        {
+            return m_dirs;
+        }
+
+        // what this mode reads from Entry, as MetaField bits
+        unsigned metaFields() const
+        {
+            switch(m_kind)
+            {
+                case SortKind::Size:
+                case SortKind::Rollup:
+                    return MetaSize;
+                case SortKind::Age:
+                    return MetaMtime;
+                case SortKind::Owner:
+                    return (MetaOwner | MetaSize);
+                default:
+                    break;
+            }
+            return 0;
+        }
+
+        /*
+        * '--stream' has to print right away, so instead of being merged afterwards, all workers
+        * of a parallel walk check one shared set. called before the walk starts, since workers
+        * may be created while it's running.
+        */
+        void shareStream()
+        {
+            if((sinkKind() == SinkKind::Stream) && (m_streamshared == nullptr))
+            {
+                // whatever earlier walks have printed already
+                m_streamshared = std::make_shared<StreamState>();
+                m_streamshared->seen = m_streamseen;
+                for(const auto& item: m_map)
+                {
+                    m_streamshared->seen.insert(item.ext);
+                }
+            }
+        }
+
+        // a fresh tally with the same mode, for one worker of a parallel walk. see merge().
+        Tally worker() const
+        {
+            Tally res(m_options, m_kind);
+            res.m_streamshared = m_streamshared;
+            return res;
+        }
+
+        /*
+        * everything counted so far, for '--emit-every' to merge() while this one goes on counting.
+        * unlike a plain copy, it has its own m_ownerlist. '--stream' has nothing to copy.
+        */
+        Tally copy() const
+        {
+            if(sinkKind() == SinkKind::Stream)
+            {
+                return worker();
+            }
+            Tally res(*this);
+            res.m_ownerlist = nullptr;
+            return res;
+        }
+
+        // '--stream' of a parallel walk prints from any worker; whatever else prints meanwhile has to hold this
+        std::unique_lock<std::mutex> lockStream()
+        {
+            if(m_streamshared == nullptr)
+            {
+                return std::unique_lock<std::mutex>();
+            }
+            return std::unique_lock<std::mutex>(m_streamshared->lock);
+        }
+
+        void merge(Tally& other)
+        {
+            int known;
+            Language lang;
+            checkPadding(other.m_padding);
+            switch(sinkKind())
+            {
+                case SinkKind::Stream:
+                    break;
+                case SinkKind::Cardinality:
+                    m_sketch.merge(other.m_sketch);
+                    break;
+                case SinkKind::Approx:
+                    m_toplist.merge(other.m_toplist);
+                    break;
+                case SinkKind::Exact:
+                    if(m_kind == SortKind::Rollup)
+                    {
+                        m_dirs.merge(other.m_dirs);
+                        break;
+                    }
+                    if(m_kind == SortKind::Depth)
+                    {
+                        m_depths.merge(other.m_depths);
+                        break;
+                    }
+                    if(m_kind == SortKind::Age)
+                    {
+                        m_ages.merge(other.m_ages);
+                        break;
+                    }
+                    if(m_kind == SortKind::Owner)
+                    {
+                        for(auto& entry: other.m_owners)
+                        {
+                            for(const auto& item: entry.second)
+                            {
+                                ownerList(entry.first).merge(item);
+                            }
+                        }
+                        break;
+                    }
+                    other.flushSlots();
+                    // back into the slots they came from, so flushSlots() doesn't count them twice
+                    for(const auto& item: other.m_map)
+                    {
+                        if(m_kind == SortKind::Language)
+                        {
+                            lang = languageByName(item.ext);
+                            m_langslots.add(size_t(lang), item.ext, item.count, m_map);
+                            continue;
+                        }
+                        if(m_kind == SortKind::Extension)
+                        {
+                            known = knownexts.find(item.ext);
+                            if(known >= 0)
+                            {
+                                m_knownslots.add(known, item.ext, item.count, m_map);
+                                continue;
+                            }
+                        }
+                        m_map.merge(item);
+                    }
+                    break;
+            }
+        }
+
+        /*
+        * for '--checkpoint': everything counted so far. it's read back into a fresh tally
+        * (see worker()), which is then merge()'d - which also puts known keys back into their slots.
+        * '--stream' has nothing to save, since it has printed its keys already.
+        */
+        void writeTo(std::ostream& os)
+        {
+            BinIO::writeVal(os, uint64_t(m_padding));
+            switch(sinkKind())
+            {
+                case SinkKind::Stream:
+                    break;
+                case SinkKind::Cardinality:
+                    m_sketch.writeTo(os);
+                    break;
+                case SinkKind::Approx:
+                    m_toplist.writeTo(os);
+                    break;
+                case SinkKind::Exact:
+                    if(m_kind == SortKind::Rollup)
+                    {
+                        m_dirs.writeTo(os);
+                        break;
+                    }
+                    if(m_kind == SortKind::Depth)
+                    {
+                        m_depths.writeTo(os);
+                        break;
+                    }
+                    if(m_kind == SortKind::Age)
+                    {
+                        m_ages.writeTo(os);
+                        break;
+                    }
+                    if(m_kind == SortKind::Owner)
+                    {
+                        BinIO::writeVal(os, uint64_t(m_owners.size()));
+                        for(const auto& entry: m_owners)
+                        {
+                            BinIO::writeVal(os, entry.first);
+                            entry.second.writeTo(os);
+                        }
+                        break;
+                    }
+                    flushSlots();
+                    m_map.writeTo(os);
+                    break;
+            }
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            uint32_t uid;
+            uint64_t count;
+            uint64_t padding;
+            if(!BinIO::readVal(is, padding))
+            {
+                return false;
+            }
+            m_padding = padding;
+            switch(sinkKind())
+            {
+                case SinkKind::Stream:
+                    return true;
+                case SinkKind::Cardinality:
+                    return m_sketch.readFrom(is);
+                case SinkKind::Approx:
+                    return m_toplist.readFrom(is);
+                case SinkKind::Exact:
+                    if(m_kind == SortKind::Rollup)
+                    {
+                        return m_dirs.readFrom(is);
+                    }
+                    if(m_kind == SortKind::Depth)
+                    {
+                        return m_depths.readFrom(is);
+                    }
+                    if(m_kind == SortKind::Age)
+                    {
+                        return m_ages.readFrom(is);
+                    }
+                    if(m_kind == SortKind::Owner)
+                    {
+                        if(!BinIO::readVal(is, count))
+                        {
+                            return false;
+                        }
+                        while(count-- > 0)
+                        {
+                            if(!BinIO::readVal(is, uid) || !m_owners[uid].readFrom(is))
+                            {
+                                return false;
+                            }
+                        }
+                        return true;
+                    }
+                    return m_map.readFrom(is);
+            }
+            return false;
+        }
+
+        /*
+        * for '--watch': takes what $other counted back out of this one, and empties $other.
+        * only for modes counted into m_map. keys that drop to 0 stay in the list (the slots
+        * point into it), and are just not printed.
+        */
+        void subtract(Tally& other)
+        {
+            flushSlots();
+            other.flushSlots();
+            for(const auto& item: other.m_map)
+            {
+                auto& mine = m_map.get(item.ext);
+                mine.count -= std::min(mine.count, item.count);
+            }
+            other.m_map = ExtList();
+            other.m_knownslots = SlotList<knownextcount>();
+            other.m_langslots = SlotList<languagecount>();
+        }
+
+        // calls fn with the Pipeline matching the current options
+        template<typename FuncT>
+        void withPipeline(FuncT&& fn)
+        {
+            switch(m_kind)
+            {
+                case SortKind::Extension:
+                    return withCase<SortKind::Extension>(fn);
+                case SortKind::Stem:
+                    return withCase<SortKind::Stem>(fn);
+                case SortKind::Filename:
+                    return withCase<SortKind::Filename>(fn);
+                case SortKind::Language:
+                    return withCase<SortKind::Language>(fn);
+                case SortKind::Size:
+                    return withCase<SortKind::Size>(fn);
+                case SortKind::Rollup:
+                    return withCase<SortKind::Rollup>(fn);
+                case SortKind::Depth:
+                    return withCase<SortKind::Depth>(fn);
+                case SortKind::Age:
+                    return withCase<SortKind::Age>(fn);
+                case SortKind::Owner:
+                    return withCase<SortKind::Owner>(fn);
+                default:
+                    std::cerr << "unimplemented sort kind" << std::endl;
+                    std::exit(1);
+                    break;
+            }
+        }
+
+        // this function is where post-processing (like turning strings lowercase)
+        // happens. new options and/or functionality that directly operate
+        // on the input string should be added here.
+        template<typename PipeT>
+        void increase(const std::string& val, Entry& entry)
+        {
+            checkPadding(val.size());
+            if constexpr(PipeT::icase)
+            {
+                CaseFold::fold(val, m_foldbuf);
+                push<PipeT>(m_foldbuf, entry);
+            }
+            else
+            {
+                push<PipeT>(val, entry);
+            }
+        }
+
+        // also used by SortKind::Size, which counts bytes per extension, and by Depth, Age and Owner
+        template<typename PipeT>
+        void modeExtension(Entry& entry)
+        {
+            std::string strext;
+            std::string bnamestr;
+            std::filesystem::path bname;
+            bname = entry.path().filename();
+            bnamestr = bname.string();
+            /*
+            * if the item path is something like "foo/bar/", then
+            * bname is just an empty string, and doesn't contain anything to work with.
+            * theoretically, this shouldn't happen, though.
+            */
+            if(!bnamestr.empty())
+            {
+                strext = bname.extension().string();
+                /*
+                * in some super funky cases, the extension might be something
+                * like "." (i.e., "foo."). i don't who or why someone would
+                * name a file like this, but still.
+                */
+                if(strext.size() > 1)
+                {
+                    increase<PipeT>(strext, entry);
+                }
+                else
+                {
+                    if constexpr(!PipeT::reject_noext)
+                    {
+                        increase<PipeT>(bnamestr, entry);
+                    }
+                }
+            }
+        }
+
+        template<typename PipeT>
+        void modeStem(Entry& entry)
+        {
+            std::string stemstr;
+            std::filesystem::path stem;
+            stem = entry.path().stem();
+            stemstr = stem.string();
+            increase<PipeT>(stemstr, entry);
+        }
+
+        template<typename PipeT>
+        void modeFilename(Entry& entry)
+        {
+            std::string bnamestr;
+            bnamestr = entry.path().filename().string();
+            if(!bnamestr.empty())
+            {
+                increase<PipeT>(bnamestr, entry);
+            }
+        }
+
+        template<typename PipeT>
+        void modeLanguage(Entry& entry)
+        {
+            Language lang;
+            std::string strext;
+            std::string bnamestr;
+            std::string_view name;
+            std::filesystem::path bname;
+            bname = entry.path().filename();
+            bnamestr = bname.string();
+            if(!bnamestr.empty())
+            {
+                strext = bname.extension().string();
+                CaseFold::fold(strext, m_foldbuf);
+                lang = languageOf(bnamestr, strext, m_foldbuf);
+                name = languagenames[size_t(lang)];
+                checkPadding(name.size());
+                if(m_langslots.increase(size_t(lang), name, m_map))
+                {
+                    if constexpr(PipeT::sink == SinkKind::Stream)
+                    {
+                        streamKey(name);
+                    }
+                }
+            }
+        }
+
+        template<typename PipeT>
+        void handleItem(Entry& entry)
+        {
+            if constexpr((PipeT::kind == SortKind::Extension) || (PipeT::kind == SortKind::Size) || (PipeT::kind == SortKind::Depth) || (PipeT::kind == SortKind::Age) || (PipeT::kind == SortKind::Owner))
+            {
+                modeExtension<PipeT>(entry);
+            }
+            else if constexpr(PipeT::kind == SortKind::Stem)
+            {
+                modeStem<PipeT>(entry);
+            }
+            else if constexpr(PipeT::kind == SortKind::Filename)
+            {
+                modeFilename<PipeT>(entry);
+            }
+            else if constexpr(PipeT::kind == SortKind::Language)
+            {
+                modeLanguage<PipeT>(entry);
+            }
+            else if constexpr(PipeT::kind == SortKind::Rollup)
+            {
+                m_dirs.add(entry.dir(), 1, entry.size());
+            }
+        }
+
+        // handleItem() through the instantiation picked in the constructor
+        void handle(Entry& entry)
+        {
+            (this->*m_handler)(entry);
+        }
+
+        std::ostream& out()
+        {
+            return *(m_options.outstream);
+        }
+
+        // what the output is sorted by
+        uint64_t sortValue(const ExtList::Item& item) const
+        {
+            if(m_kind == SortKind::Size)
+            {
+                return item.size;
+            }
+            return item.count;
+        }
+
+        uint64_t sortValue(const SpaceSaving::Item& item) const
+        {
+            return item.count;
+        }
+
+        template<typename ListT>
+        void sort(ListT& list)
+        {
+            std::sort(list.begin(), list.end(), [&](const auto& lhs, const auto& rhs)
+            {
+                return (sortValue(lhs) < sortValue(rhs));
+            });
+        }
+
+        // prints $key, unless another worker already has
+        void streamKey(std::string_view key)
+        {
+            if(m_streamshared == nullptr)
+            {
+                printStreamed(key);
+                return;
+            }
+            std::lock_guard<std::mutex> guard(m_streamshared->lock);
+            if(m_streamshared->seen.emplace(key).second)
+            {
+                printStreamed(key);
+            }
+        }
+
+        // flushed right away, so whatever reads the output sees keys as they come in
+        void printStreamed(std::string_view key)
+        {
+            if(m_options.sortkinds.size() > 1)
+            {
+                out() << "[" << sortKindName(m_kind) << "] ";
+            }
+            out() << key << std::endl;
+        }
+
+        void printVals(const std::string& ext, const size_t& count)
+        {
+            std::stringstream buf;
+            size_t realpad;
+            if(m_options.collectonly)
+            {
+                out() << ext << '\n';
+            }
+            else
+            {
+                realpad = (m_padding + 2);
+                out() << std::setw(realpad) << ext << " " << count << '\n';
+            }
+        }
+
+        // 2^$exp as "512", "4K", "16M", ...
+        static std::string pow2Name(size_t exp)
+        {
+            static const char* units[] = {"", "K", "M", "G", "T", "P", "E"};
+            return (std::to_string(uint64_t(1) << (exp % 10)) + units[exp / 10]);
+        }
+
+        // "p50<4K p90<1M p99<64M": the bucket each percentile falls into, by its upper bound
+        void printPercentiles(const SizeHistogram& hist)
+        {
+            out() << " p50<" << pow2Name(hist.quantileBucket(0.50) + 1);
+            out() << " p90<" << pow2Name(hist.quantileBucket(0.90) + 1);
+            out() << " p99<" << pow2Name(hist.quantileBucket(0.99) + 1);
+        }
+
+        // "[<1K:3 <2K:10 ...]": every non-empty bucket; '--histogram'
+        void printHistogram(const SizeHistogram& hist)
+        {
+            size_t b;
+            bool first;
+            first = true;
+            out() << " [";
+            for(b=0; b<SizeHistogram::bucketcount; b++)
+            {
+                if(hist.at(b) > 0)
+                {
+                    out() << (first ? "" : " ") << "<" << pow2Name(b + 1) << ":" << hist.at(b);
+                    first = false;
+                }
+            }
+            out() << "]";
+        }
+
+        void printItem(const ExtList::Item& item)
+        {
+            size_t realpad;
+            if((m_kind == SortKind::Size) && (!m_options.collectonly))
+            {
+                realpad = (m_padding + 2);
+                out() << std::setw(realpad) << item.ext << " " << item.count << " " << item.size;
+                if(!item.hist.empty())
+                {
+                    printPercentiles(item.hist);
+                    if(m_options.printhistogram)
+                    {
+                        printHistogram(item.hist);
+                    }
+                }
+                out() << '\n';
+            }
+            else
+            {
+                printVals(item.ext, item.count);
+            }
+        }
+
+        // the true count lies within [count - error, count]
+        void printItem(const SpaceSaving::Item& item)
+        {
+            size_t realpad;
+            if(m_options.collectonly || (item.error == 0))
+            {
+                printVals(item.ext, item.count);
+            }
+            else
+            {
+                realpad = (m_padding + 2);
+                out() << std::setw(realpad) << item.ext << " " << item.count << " (error: " << item.error << ")" << '\n';
+            }
+        }
+
+        template<typename ListT>
+        void printList(ListT& list)
+        {
+            if(m_options.sortvals && (!m_options.collectonly))
+            {
+                sort(list);
+            }
+            if(m_options.revoutput && (!m_options.collectonly))
+            {
+                for(auto it=list.rbegin(); it!=list.rend(); it++)
+                {
+                    printItem(*it);
+                }
+            }
+            else
+            {
+                for(auto it=list.begin(); it!=list.end(); it++)
+                {
+                    printItem(*it);
+                }
+            }
+        }
+
+        // the '--top' subtrees with the most files, as "path files bytes"
+        void printRollup()
+        {
+            size_t i;
+            size_t count;
+            size_t realpad;
+            std::vector<const DirTable::Node*> top;
+            m_dirs.rollup(m_options.jobs);
+            for(const auto& node: m_dirs.nodes())
+            {
+                top.push_back(&node);
+            }
+            count = std::min(top.size(), m_options.topcount);
+            std::partial_sort(top.begin(), top.begin() + count, top.end(), [](const DirTable::Node* lhs, const DirTable::Node* rhs)
+            {
+                return (lhs->files > rhs->files);
+            });
+            top.resize(count);
+            // like everything else: heaviest last, unless '-r'
+            if(!m_options.revoutput)
+            {
+                std::reverse(top.begin(), top.end());
+            }
+            for(i=0; i<top.size(); i++)
+            {
+                checkPadding(top[i]->path.size());
+            }
+            realpad = (m_padding + 2);
+            for(i=0; i<top.size(); i++)
+            {
+                if(m_options.collectonly)
+                {
+                    out() << top[i]->path << '\n';
+                }
+                else
+                {
+                    out() << std::setw(realpad) << top[i]->path << " " << top[i]->files << " " << top[i]->bytes << '\n';
+                }
+            }
+        }
+
+        /*
+        * one row per key, one column per bucket. like everything else, keys are sorted by
+        * their total count, largest last.
+        * with '--json', the same as {"<name>s": [columns...], "keys": [...], "counts": [[...], ...]},
+        * where counts[i][b] belongs to keys[i] in bucket b.
+        */
+        void printTable(const BucketTable& table, const char* name, const std::vector<std::string>& columns, bool numeric)
+        {
+            size_t i;
+            size_t id;
+            size_t col;
+            size_t width;
+            size_t realpad;
+            std::vector<size_t> order;
+            const auto& keys = table.keys();
+            for(id=0; id<keys.size(); id++)
+            {
+                order.push_back(id);
+            }
+            if(m_options.sortvals)
+            {
+                std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+                {
+                    return (table.total(lhs) < table.total(rhs));
+                });
+            }
+            if(m_options.revoutput)
+            {
+                std::reverse(order.begin(), order.end());
+            }
+            if(m_options.jsonoutput)
+            {
+                out() << "{\"" << name << "s\": [";
+                for(col=0; col<columns.size(); col++)
+                {
+                    out() << ((col > 0) ? ", " : "");
+                    if(numeric)
+                    {
+                        out() << columns[col];
+                    }
+                    else
+                    {
+                        printJsonString(out(), columns[col]);
+                    }
+                }
+                out() << "], \"keys\": [";
+                for(i=0; i<order.size(); i++)
+                {
+                    out() << ((i > 0) ? ", " : "");
+                    printJsonString(out(), keys[order[i]]);
+                }
+                out() << "], \"counts\": [";
+                for(i=0; i<order.size(); i++)
+                {
+                    out() << ((i > 0) ? ", " : "") << "[";
+                    for(col=0; col<columns.size(); col++)
+                    {
+                        out() << ((col > 0) ? ", " : "") << table.at(col, order[i]);
+                    }
+                    out() << "]";
+                }
+                out() << "]}" << '\n';
+                return;
+            }
+            if(m_options.collectonly)
+            {
+                for(auto id: order)
+                {
+                    out() << keys[id] << '\n';
+                }
+                return;
+            }
+            // wide enough for the largest count, and the widest column name
+            width = 1;
+            for(const auto& column: columns)
+            {
+                width = std::max(width, column.size());
+            }
+            for(id=0; id<keys.size(); id++)
+            {
+                width = std::max(width, std::to_string(table.total(id)).size());
+            }
+            realpad = (m_padding + 2);
+            out() << std::setw(realpad) << name;
+            for(const auto& column: columns)
+            {
+                out() << " " << std::setw(width) << column;
+            }
+            out() << '\n';
+            for(auto id: order)
+            {
+                out() << std::setw(realpad) << keys[id];
+                for(col=0; col<columns.size(); col++)
+                {
+                    out() << " " << std::setw(width) << table.at(col, id);
+                }
+                out() << '\n';
+            }
+        }
+
+        void printDepths()
+        {
+            size_t depth;
+            std::vector<std::string> columns;
+            for(depth=0; depth<m_depths.bucketCount(); depth++)
+            {
+                columns.push_back(std::to_string(depth));
+            }
+            printTable(m_depths, "depth", columns, true);
+        }
+
+        void printAges()
+        {
+            std::vector<std::string> columns(std::begin(agenames), std::end(agenames));
+            printTable(m_ages, "age", columns, false);
+        }
+
+        // "user ext files bytes", one line per (user, extension) pair, sorted by files
+        void printOwners()
+        {
+            size_t namepad;
+            size_t realpad;
+            UserNames names;
+            std::vector<std::pair<uint32_t, const ExtList::Item*>> rows;
+            namepad = 0;
+            for(auto& entry: m_owners)
+            {
+                namepad = std::max(namepad, names.nameOf(entry.first).size());
+                for(const auto& item: entry.second)
+                {
+                    rows.emplace_back(entry.first, &item);
+                }
+            }
+            if(m_options.sortvals)
+            {
+                std::stable_sort(rows.begin(), rows.end(), [](const auto& lhs, const auto& rhs)
+                {
+                    return (lhs.second->count < rhs.second->count);
+                });
+            }
+            if(m_options.revoutput)
+            {
+                std::reverse(rows.begin(), rows.end());
+            }
+            realpad = (m_padding + 2);
+            for(const auto& row: rows)
+            {
+                out() << std::setw(namepad + 2) << names.nameOf(row.first) << " " << std::setw(realpad) << row.second->ext;
+                if(!m_options.collectonly)
+                {
+                    out() << " " << row.second->count << " " << row.second->size;
+                }
+                out() << '\n';
+            }
+        }
+
+        void printCardinality()
+        {
+            double est;
+            est = m_sketch.estimate();
+            verboseMsg(m_options, "estimated distinct keys: %.0f (standard error: %.2f%%)", est, m_sketch.stdError() * 100.0);
+            out() << size_t(std::llround(est)) << '\n';
+        }
+
+        void printOutput()
+        {
+            SinkKind sink;
+            sink = sinkKind();
+            if(sink == SinkKind::Stream)
+            {
+                // everything has been printed already
+                return;
+            }
+            else if(sink == SinkKind::Cardinality)
+            {
+                printCardinality();
+            }
+            else if(m_kind == SortKind::Rollup)
+            {
+                printRollup();
+            }
+            else if(m_kind == SortKind::Depth)
+            {
+                printDepths();
+            }
+            else if(m_kind == SortKind::Age)
+            {
+                printAges();
+            }
+            else if(m_kind == SortKind::Owner)
+            {
+                printOwners();
+            }
+            else if(sink == SinkKind::Approx)
+            {
+                auto items = m_toplist.items();
+                verboseMsg(m_options, "approximate counts: %zu keys seen, %zu counters; unlisted keys occurred at most %zu times",
+                    m_toplist.total(), m_toplist.size(), m_toplist.minCount());
+                printList(items);
+            }
+            else if(m_options.watch)
+            {
+                // still counted into afterwards, so m_map mustn't be reordered
+                std::vector<ExtList::Item> items;
+                flushSlots();
+                for(const auto& item: m_map)
+                {
+                    if(item.count > 0)
+                    {
+                        items.push_back(item);
+                    }
+                }
+                printList(items);
+            }
+            else
+            {
+                flushSlots();
+                printList(m_map);
+            }
+        }
+};
+
+class CountFiles
+{
+    private:
+        Config& m_options;
+        // one per mode, in the order they were given
+        std::vector<Tally> m_tallies;
+        // scratch space for case folding '--only' extensions
+        std::string m_foldbuf;
+        // the extensions given to '--only' (case-folded with '--nocase'), and the table over them
+        std::vector<std::string> m_onlyexts;
+        OnlySet m_onlyset;
+        // MetaField bits needed by any tally or filter, so Entry can fetch them all at once
+        unsigned m_metafields = 0;
+        // for '--unique-inodes'
+        InodeSet m_inodes;
+        // for '--max-rate'; taken once per directory
+        TokenBucket m_throttle;
+        // if set, called (from any worker) with every directory DirWalker reads; used by '--watch'
+        std::function<void(const std::string&)> m_ondirectory;
+        // for '--emit-every' on walks that run on the calling thread; see emitIfDue()
+        std::chrono::steady_clock::time_point m_nextemit;
+        size_t m_emitcheck = 0;
+        // only set while '--resume' walks; see resumeDirectories()
+        std::unique_ptr<Checkpoint> m_resume;
+        #if defined(COE_ISUNIXLIKE)
+            // with '--watch', the one '--cache' shared by every walk of the session; see watchDirectories()
+            DirCache* m_sessioncache = nullptr;
+        #endif
+
+    private:
+        // this function will attempt to remove '\r\n'.
+        // this only applies to listing files.
+        // it will effectively do nothing if the string does not contain a '\r'
+        void fixCR(std::string& str)
+        {
+            if(!str.empty() && (str[str.size() - 1] == '\r'))
+            {
+                str.erase(str.size() - 1);
+            }
+        }
+
+        void shortenpath(std::string& rawpath)
+        {
+            size_t plen;
+            while(true)
+            {
+                plen = rawpath.size();
+                rawpath = rawpath.substr(10, plen);
+                if(rawpath.size() < CFILES_MAXPATHLEN)
+                {
+                    break;
+                }
+            }
+        }
+
+        template<bool only, bool icase, bool newer, typename FuncT>
+        void withFlagsUnique(FuncT&& fn)
+        {
+            if(m_options.uniqueinodes)
+            {
+                return fn(WalkFlags<only, icase, newer, true>{});
+            }
+            return fn(WalkFlags<only, icase, newer, false>{});
+        }
+
+        template<bool only, bool icase, typename FuncT>
+        void withFlagsNewer(FuncT&& fn)
+        {
+            if(m_options.havenewer)
+            {
+                return withFlagsUnique<only, icase, true>(fn);
+            }
+            return withFlagsUnique<only, icase, false>(fn);
+        }
+
+        template<typename FuncT>
+        void withFlags(FuncT&& fn)
+        {
+            // without '--only', the case isn't looked at, so it doesn't need an instantiation of its own
+            if(m_onlyset.size() == 0)
+            {
+                return withFlagsNewer<false, false>(fn);
+            }
+            if(m_options.icase)
+            {
+                return withFlagsNewer<true, true>(fn);
+            }
+            return withFlagsNewer<true, false>(fn);
+        }
+
+        /*
+        * calls fn with the WalkFlags matching the current options, and a handler for entries.
+        * with a single mode, the handler is that tally's fully specialized handleItem(); with
+        * several, it hands each entry to every tally through their (also specialized) handle().
+        * the handler is given the tallies to count into, since parallel walks have one set per worker.
+        * '--newer' and '--unique-inodes' stat every entry, which handle() is cheap next to, so
+        * they always go through it - which keeps them from multiplying every Pipeline.
+        */
+        template<typename FuncT>
+        void withHandler(FuncT&& fn)
+        {
+            withFlags([&](auto flags)
+            {
+                using FlagsT = decltype(flags);
+                if constexpr(!FlagsT::newer && !FlagsT::unique)
+                {
+                    if(m_tallies.size() == 1)
+                    {
+                        return m_tallies[0].withPipeline([&](auto pipe)
+                        {
+                            using PipeT = decltype(pipe);
+                            fn(flags, [&](std::vector<Tally>& tallies, Entry& entry)
+                            {
+                                if(acceptEntry<FlagsT>(entry))
+                                {
+                                    tallies[0].template handleItem<PipeT>(entry);
+                                }
+                            });
+                        });
+                    }
+                }
+                fn(flags, [&](std::vector<Tally>& tallies, Entry& entry)
+                {
+                    if(!acceptEntry<FlagsT>(entry))
+                    {
+                        return;
+                    }
+                    for(auto& tally: tallies)
+                    {
+                        tally.handle(entry);
+                    }
+                });
+            });
+        }
+
+        // sets up $entry's metadata fetch, and checks the filters that need metadata ('--newer', '--unique-inodes')
+        template<typename FlagsT>
+        bool acceptEntry(Entry& entry)
+        {
+            entry.want(m_metafields);
+            if constexpr(FlagsT::newer)
+            {
+                if(entry.mtime() <= m_options.newerthan)
+                {
+                    return false;
+                }
+            }
+            if constexpr(FlagsT::unique)
+            {
+                // files with a single link can only be seen once anyway, so they don't need tracking
+                if((entry.nlink() > 1) && !m_inodes.insert(entry.dev(), entry.ino()))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void buildOnlySet()
+        {
+            std::vector<std::string_view> views;
+            for(const auto& ext: m_options.onlyexts)
+            {
+                if(m_options.icase)
+                {
+                    CaseFold::fold(ext, m_foldbuf);
+                    m_onlyexts.push_back(m_foldbuf);
+                }
+                else
+                {
+                    m_onlyexts.push_back(ext);
+                }
+            }
+            std::sort(m_onlyexts.begin(), m_onlyexts.end());
+            m_onlyexts.erase(std::unique(m_onlyexts.begin(), m_onlyexts.end()), m_onlyexts.end());
+            // m_onlyexts must not change past this point - m_onlyset points into it
+            for(const auto& ext: m_onlyexts)
+            {
+                views.push_back(ext);
+            }
+            m_onlyset = OnlySet(views.data(), views.size());
+            if(!m_onlyset.ok())
+            {
+                std::cerr << "failed to build lookup table for '--only' (too many extensions?)" << std::endl;
+                std::exit(1);
+            }
+        }
+
+        /*
+        * the extension of the last component of $rawpath, following the same rules as
+        * std::filesystem::path::extension() - but without having to construct a path first.
+        */
+        static std::string_view rawExtension(std::string_view rawpath)
+        {
+            size_t pos;
+            std::string_view name;
+            #if defined(COE_ISWINDOWS)
+                pos = rawpath.find_last_of("/\\");
+            #else
+                pos = rawpath.find_last_of('/');
+            #endif
+            name = ((pos == std::string_view::npos) ? rawpath : rawpath.substr(pos + 1));
+            if((name == ".") || (name == ".."))
+            {
+                return {};
+            }
+            pos = name.find_last_of('.');
+            if((pos == std::string_view::npos) || (pos == 0))
+            {
+                return {};
+            }
+            return name.substr(pos);
+        }
+
+        // whether $rawpath passes '--only'. checked before anything else is done with the path.
+        template<typename FlagsT>
+        bool acceptOnly(std::string_view rawpath, std::string& foldbuf)
+        {
+            std::string_view ext;
+            ext = rawExtension(rawpath);
+            if(ext.size() < 2)
+            {
+                return false;
+            }
+            if constexpr(FlagsT::icase)
+            {
+                CaseFold::fold(ext, foldbuf);
+                return (m_onlyset.find(foldbuf) >= 0);
+            }
+            else
+            {
+                return (m_onlyset.find(ext) >= 0);
+            }
+        }
+
+        template<typename FlagsT>
+        bool acceptOnly(const std::filesystem::path& path)
+        {
+            if constexpr(std::is_same_v<std::filesystem::path::value_type, char>)
+            {
+                return acceptOnly<FlagsT>(std::string_view(path.native()), m_foldbuf);
+            }
+            else
+            {
+                auto str = path.string();
+                return acceptOnly<FlagsT>(std::string_view(str), m_foldbuf);
+            }
+        }
+
+        // whether to skip $checkthis, and everything below it ('--prune')
+        bool shouldPrune(const std::filesystem::path& checkthis)
+        {
+            for(auto& prunethis: m_options.pruneme)
+            {
+                if(prunethis.empty())
+                {
+                    continue;
+                }
+                //std::cerr << "checkthis.parent_path() = " << checkthis.parent_path() << std::endl;
+                //std::cerr << "prunethis.parent_path() = " << prunethis.parent_path().string() << std::endl;
+                // todo: add option to ignore case maybe?
+                // first, check if the paths match as-is ...
+                if(checkthis == prunethis)
+                {
+                    return true;
+                }
+                // then, check if filename (in case of directories, the dirname) is equal ...
+                if(checkthis.has_parent_path() && ((!prunethis.empty()) && prunethis.has_parent_path()))
+                {
+
+                    if(checkthis.parent_path() == prunethis.parent_path())
+                    {
+                        return true;
+                    }
+                }
+                // lastly, do a lexical check
+                return ((checkthis.compare(prunethis)) >= 0);
+            }
+            return false;
+        }
+
+    public:
+        CountFiles(Config& opts): m_options(opts)
+        {
+            m_tallies.reserve(m_options.sortkinds.size());
+            for(auto kind: m_options.sortkinds)
+            {
+                m_tallies.emplace_back(m_options, kind);
+                m_metafields |= m_tallies.back().metaFields();
+            }
+            if(m_options.havenewer)
+            {
+                m_metafields |= MetaMtime;
+            }
+            if(m_options.uniqueinodes)
+            {
+                m_metafields |= MetaInode;
+            }
+            if(!m_options.onlyexts.empty())
+            {
+                buildOnlySet();
+            }
+            m_throttle.setRate(m_options.maxrate);
+            m_nextemit = (std::chrono::steady_clock::now() + emitInterval());
+        }
+
+        std::ostream& out()
+        {
+            return *(m_options.outstream);
+        }
+
+        template<typename... Args>
+        void verbose(const char* fmt, Args&&... args)
+        {
+            verboseMsg(m_options, fmt, args...);
+        }
+
+        void walkFilestream(std::istream& infh)
+        {
+            withHandler([&](auto flags, auto&& handler)
+            {
+                walkFilestreamWith<decltype(flags)>(infh, handler);
+            });
+        }
+
+        // whether walking directories needs DirWalker, rather than Find::Finder
+        bool useDirWalker() const
+        {
+            #if defined(COE_ISUNIXLIKE)
+                return ((m_options.jobs > 1) || m_options.autojobs || m_options.follow || m_options.onefs || m_options.perdevice || m_options.inodeorder || (!m_options.cachefile.empty()) || m_options.watch || (!m_options.checkpointfile.empty()));
+            #else
+                return false;
+            #endif
+        }
+
+        // Find::Finder walks one root after another; DirWalker walks them all at once
+        void walkDirectories(const std::vector<std::string>& dirs)
+        {
+            for(auto& tally: m_tallies)
+            {
+                if(tally.kind() == SortKind::Rollup)
+                {
+                    for(const auto& dir: dirs)
+                    {
+                        tally.dirs().addRoot(dir);
+                    }
+                }
+            }
+            withHandler([&](auto flags, auto&& handler)
+            {
+                #if defined(COE_ISUNIXLIKE)
+                    if(useDirWalker())
+                    {
+                        return walkDirectoryParallel<decltype(flags)>(dirs, handler);
+                    }
+                #endif
+                for(const auto& dir: dirs)
+                {
+                    walkDirectoryWith<decltype(flags)>(dir, handler);
+                }
+            });
+        }
+
+        void walkDirectory(const std::string& dir)
+        {
+            walkDirectories({dir});
+        }
+
+        #if defined(COE_ISUNIXLIKE)
+        void loadCache(DirCache& cache)
+        {
+            if(!cache.load(m_options.cachefile))
+            {
+                std::cerr << "warning: \"" << m_options.cachefile << "\" is not a valid cache file, starting over" << std::endl;
+            }
+            cache.setStart(m_options.starttime);
+        }
+
+        void saveCache(DirCache& cache)
+        {
+            verbose("cache: %zu directories unchanged, %zu read", cache.hits(), cache.misses());
+            if(!cache.save(m_options.cachefile))
+            {
+                std::cerr << "failed to write cache to '" << m_options.cachefile << "': " << std::strerror(errno) << std::endl;
+            }
+        }
+        #endif
+
+        #if defined(COE_ISLINUX)
+        /*
+        * '--watch': walks $dirs, adding every directory to a DirWatcher just before it's read,
+        * and then keeps the counts current with what it reports, until SIGINT or SIGTERM.
+        * files are counted into m_tallies as they show up; removed ones are counted into a
+        * scratch set of tallies, which is then subtracted. a file created right as its
+        * directory is being read may be seen twice - once by the walk, once as an event.
+        * with '--cache', the initial walk and every one after it (of new directories, or after
+        * losing track) share one DirCache, which is only saved once the session ends.
+        */
+        void watchDirectories(const std::vector<std::string>& dirs)
+        {
+            bool lost;
+            DirCache cache;
+            DirWatcher watcher;
+            if(!watcher.open())
+            {
+                std::cerr << "error: failed to set up inotify: " << std::strerror(errno) << std::endl;
+                std::exit(1);
+            }
+            m_ondirectory = [&](const std::string& path)
+            {
+                watcher.add(path);
+            };
+            if(!m_options.cachefile.empty())
+            {
+                loadCache(cache);
+                m_sessioncache = &cache;
+            }
+            walkDirectories(dirs);
+            verbose("watching %zu directories", watcher.size());
+            if(watcher.failed() > 0)
+            {
+                std::cerr << "warning: failed to watch " << watcher.failed() << " directories (is fs.inotify.max_user_watches too low?)" << std::endl;
+            }
+            // after losing track, the tallies are started over out here, where withHandler() isn't holding on to them
+            while(true)
+            {
+                lost = false;
+                withHandler([&](auto flags, auto&& handler)
+                {
+                    using FlagsT = decltype(flags);
+                    std::vector<Tally> scratch;
+                    for(const auto& tally: m_tallies)
+                    {
+                        scratch.push_back(tally.worker());
+                    }
+                    lost = watcher.run(m_options.watchinterval, [&](DirWatcher::Event ev, const std::string& rawpath)
+                    {
+                        std::filesystem::path path(rawpath);
+                        switch(ev)
+                        {
+                            case DirWatcher::Event::FileAdded:
+                            case DirWatcher::Event::FileRemoved:
+                                {
+                                    if constexpr(FlagsT::only)
+                                    {
+                                        if(!acceptOnly<FlagsT>(path))
+                                        {
+                                            return;
+                                        }
+                                    }
+                                    Entry entry(path);
+                                    if(ev == DirWatcher::Event::FileAdded)
+                                    {
+                                        handler(m_tallies, entry);
+                                        return;
+                                    }
+                                    handler(scratch, entry);
+                                    for(size_t i=0; i<m_tallies.size(); i++)
+                                    {
+                                        m_tallies[i].subtract(scratch[i]);
+                                    }
+                                }
+                                break;
+                            case DirWatcher::Event::DirectoryAdded:
+                                if(!shouldPrune(path))
+                                {
+                                    walkDirectories({rawpath});
+                                }
+                                break;
+                            case DirWatcher::Event::Lost:
+                                verbose("lost track of changes (%s), counting again", (rawpath.empty() ? "event queue overflowed" : rawpath.c_str()));
+                                break;
+                            case DirWatcher::Event::Emit:
+                                printOutput();
+                                out() << std::endl;
+                                break;
+                        }
+                    });
+                });
+                if(!lost)
+                {
+                    break;
+                }
+                if(!watcher.reset())
+                {
+                    std::cerr << "error: failed to set up inotify: " << std::strerror(errno) << std::endl;
+                    std::exit(1);
+                }
+                resetTallies();
+                walkDirectories(dirs);
+            }
+            m_ondirectory = nullptr;
+            if(m_sessioncache != nullptr)
+            {
+                saveCache(cache);
+                m_sessioncache = nullptr;
+            }
+        }
+        #endif
+
+        #if defined(COE_ISUNIXLIKE)
+        /*
+        * '--resume': continues the walk that was checkpointed to $path. what was counted before
+        * goes straight into m_tallies, and DirWalker is only given the directories that were left.
+        */
+        bool resumeDirectories(const std::string& path)
+        {
+            auto cp = std::make_unique<Checkpoint>();
+            if(!cp->load(path))
+            {
+                std::cerr << "error: failed to read checkpoint from \"" << path << "\"" << std::endl;
+                return false;
+            }
+            if(cp->settings != checkpointSettings())
+            {
+                std::cerr << "error: \"" << path << "\" was made with different options (" << cp->settings << ")" << std::endl;
+                return false;
+            }
+            auto& counts = cp->counts;
+            for(auto& tally: m_tallies)
+            {
+                Tally loaded = tally.worker();
+                if(!loaded.readFrom(counts))
+                {
+                    std::cerr << "error: \"" << path << "\" is not a valid checkpoint file" << std::endl;
+                    return false;
+                }
+                tally.merge(loaded);
+            }
+            if(!m_inodes.readFrom(counts))
+            {
+                std::cerr << "error: \"" << path << "\" is not a valid checkpoint file" << std::endl;
+                return false;
+            }
+            // so '--mode=age' stays relative to when the walk first started
+            m_options.starttime = cp->starttime;
+            counts.close();
+            verbose("resuming with %zu directories left", cp->pending.size());
+            m_resume = std::move(cp);
+            walkDirectories(m_resume->roots);
+            m_resume = nullptr;
+            return true;
+        }
+        #endif
+
+        // walks $dirs, and with '--watch', keeps watching them afterwards
+        void countDirectories(const std::vector<std::string>& dirs)
+        {
+            #if defined(COE_ISLINUX)
+                if(m_options.watch)
+                {
+                    return watchDirectories(dirs);
+                }
+            #endif
+            walkDirectories(dirs);
+        }
+
+        // starts all modes over from nothing
+        void resetTallies()
+        {
+            m_tallies.clear();
+            for(auto kind: m_options.sortkinds)
+            {
+                m_tallies.emplace_back(m_options, kind);
+            }
+        }
+
+        template<typename FlagsT, typename HandlerT>
+        void walkFilestreamWith(std::istream& infh, HandlerT& handler)
+        {
+            if(m_options.emitevery > 0)
+            {
+                return walkFilestreamLines<FlagsT, true>(infh, handler);
+            }
+            return walkFilestreamLines<FlagsT, false>(infh, handler);
+        }
+
+        // $emit: whether to check for '--emit-every', which has no directories to go by here
+        template<typename FlagsT, bool emit, typename HandlerT>
+        void walkFilestreamLines(std::istream& infh, HandlerT& handler)
+        {
+            std::string line;
+            while(std::getline(infh, line))
+            {
+                fixCR(line);
+                if(line.size() >= CFILES_MAXPATHLEN)
+                {
+                    shortenpath(line);
+                }
+                //std::cerr << "line=" << line << '\n';
+                if constexpr(FlagsT::only)
+                {
+                    if(!acceptOnly<FlagsT>(std::string_view(line), m_foldbuf))
+                    {
+                        continue;
+                    }
+                }
+                try
+                {
+                    std::filesystem::path path(line);
+                    Entry entry(path);
+                    handler(m_tallies, entry);
+                    if constexpr(emit)
+                    {
+                        if(((++m_emitcheck) % 1024) == 0)
+                        {
+                            emitIfDue();
+                        }
+                    }
+                }
+                catch(std::exception& ex)
+                {
+                    std::cerr << "in walkFilestream: " << ex.what() << "(line: \"" << line << "\")" << std::endl;
+                }
+            }
+        }
+
+        template<typename FlagsT, typename HandlerT>
+        void walkDirectoryWith(const std::string& dir, HandlerT& handler)
+        {
+            size_t basedepth;
+            Find::Finder fi(dir);
+            basedepth = separatorCount(dir + "/");
+            fi.setMaxDepth(m_options.maxdepth);
+            fi.onException([&](const std::exception& ex, const std::string& orig, const std::filesystem::path& p)
+            {
+                std::string exmsg;
+                exmsg = ex.what();
+                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\r'), exmsg.end());
+                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\n'), exmsg.end());
+                std::cerr << "ERROR: in '" << orig << "': path \"" << p.string() << "\": " << exmsg << std::endl;
+            });
+            fi.skipItemIf([&](const std::filesystem::path& checkthis, bool isdir, bool isfile)
+            {
+                (void)isfile;
+                if(isdir)
+                {
+                    verbose("current path: %s", checkthis.string().c_str());
+                    m_throttle.take();
+                    if(m_options.emitevery > 0)
+                    {
+                        emitIfDue();
+                    }
+                }
+                return (isdir);
+            });
+
+            fi.pruneIf([&](const std::filesystem::path& checkthis)
+            {
+                return shouldPrune(checkthis);
+            });
+
+            fi.walk([&](const std::filesystem::path& path)
+            {
+                if constexpr(FlagsT::only)
+                {
+                    if(!acceptOnly<FlagsT>(path))
+                    {
+                        return;
+                    }
+                }
+                Entry entry(path);
+                entry.setBaseDepth(basedepth);
+                handler(m_tallies, entry);
+            });
+        }
+
+        #if defined(COE_ISUNIXLIKE)
+        // the options that change what's counted. a checkpoint can only be resumed with the same ones
+        std::string checkpointSettings() const
+        {
+            std::ostringstream res;
+            for(auto kind: m_options.sortkinds)
+            {
+                res << sortKindName(kind) << ',';
+            }
+            res << " icase=" << m_options.icase << " noext=" << m_options.reject_noext;
+            res << " approx=" << m_options.approxcount << " cardinality=" << m_options.cardinality;
+            res << " maxdepth=" << m_options.maxdepth << " follow=" << m_options.follow << " onefs=" << m_options.onefs;
+            res << " unique=" << m_options.uniqueinodes << " newer=" << (m_options.havenewer ? m_options.newerthan : 0);
+            for(const auto& ext: m_options.onlyexts)
+            {
+                res << " only=" << ext;
+            }
+            for(const auto& path: m_options.pruneme)
+            {
+                res << " prune=" << path.string();
+            }
+            return res.str();
+        }
+
+        /*
+        * '--checkpoint': saves the walk of $roots, with $jobs still to go. called by DirWalker
+        * while it's paused, so $sets all hold what was counted from every directory that's done.
+        */
+        bool saveCheckpoint(const std::vector<std::string>& roots, const std::vector<DirWalker::Job>& jobs, const DirWalker& dw, const std::vector<std::vector<Tally>*>& sets)
+        {
+            Checkpoint cp;
+            cp.settings = checkpointSettings();
+            cp.starttime = m_options.starttime;
+            cp.roots = roots;
+            for(const auto& job: jobs)
+            {
+                cp.pending.push_back(Checkpoint::Pending{job.path, uint64_t(job.depth), uint64_t(job.root)});
+            }
+            for(const auto& vis: dw.visited())
+            {
+                cp.visited.emplace_back(uint64_t(vis.first), uint64_t(vis.second));
+            }
+            auto snapshot = snapshotOf(sets);
+            return cp.save(m_options.checkpointfile, [&](std::ostream& os)
+            {
+                for(auto& tally: snapshot)
+                {
+                    tally.writeTo(os);
+                }
+                m_inodes.writeTo(os);
+            });
+        }
+
+        /*
+        * same as walkDirectoryWith, but on DirWalker, for all of $dirs at once. with '--jobs'
+        * (or '--per-device'), that's several threads - though it may well be just the one.
+        * worker 0 counts into m_tallies, the others into their own, which are merged afterwards.
+        */
+        template<typename FlagsT, typename HandlerT>
+        void walkDirectoryParallel(const std::vector<std::string>& dirs, HandlerT& handler)
+        {
+            std::mutex errlock;
+            DirCache cache;
+            DirWalker dw;
+            if(m_sessioncache != nullptr)
+            {
+                dw.setCache(m_sessioncache);
+            }
+            else if(!m_options.cachefile.empty())
+            {
+                loadCache(cache);
+                dw.setCache(&cache);
+            }
+            if(m_resume != nullptr)
+            {
+                for(const auto& vis: m_resume->visited)
+                {
+                    dw.addVisited(dev_t(vis.first), ino_t(vis.second));
+                }
+            }
+            dw.setJobs(m_options.jobs);
+            dw.setMaxDepth(m_options.maxdepth);
+            dw.setFollow(m_options.follow);
+            dw.setOneFileSystem(m_options.onefs);
+            dw.setPerDevice(m_options.perdevice);
+            dw.setAdaptive(m_options.autojobs);
+            dw.onTune([&](const std::string& path, size_t jobs)
+            {
+                std::lock_guard<std::mutex> guard(errlock);
+                verbose("using %zu threads for the device of '%s'", jobs, path.c_str());
+            });
+            // with '--per-device', workers only come into existence with the pools of their device,
+            // so their tallies are created by the workers themselves, in their own slot
+            std::vector<std::vector<Tally>*> sets(dw.maxWorkers(), nullptr);
+            std::vector<std::unique_ptr<std::vector<Tally>>> owned(dw.maxWorkers());
+            std::vector<std::string> foldbufs(dw.maxWorkers());
+            std::thread emitter;
+            std::mutex emitlock;
+            std::condition_variable emitcond;
+            bool walked = false;
+            sets[0] = &m_tallies;
+            for(auto& tally: m_tallies)
+            {
+                tally.shareStream();
+            }
+            dw.onError([&](const std::string& root, const std::string& path, int err)
+            {
+                std::lock_guard<std::mutex> guard(errlock);
+                std::cerr << "ERROR: in '" << root << "': path \"" << path << "\": " << std::strerror(err) << std::endl;
+            });
+            if(m_options.verbose || m_throttle.enabled() || m_ondirectory)
+            {
+                dw.onDirectory([&](const std::string& path)
+                {
+                    if(m_options.verbose)
+                    {
+                        std::lock_guard<std::mutex> guard(errlock);
+                        verbose("current path: %s", path.c_str());
+                    }
+                    if(m_ondirectory)
+                    {
+                        m_ondirectory(path);
+                    }
+                    m_throttle.take();
+                });
+            }
+            if(!m_options.pruneme.empty())
+            {
+                dw.pruneIf([&](const std::string& path)
+                {
+                    return shouldPrune(std::filesystem::path(path));
+                });
+            }
+            // '--only' goes by the name that readdir() gave, so files it drops are never copied
+            if constexpr(FlagsT::only)
+            {
+                dw.acceptIf([&](size_t worker, const char* name)
+                {
+                    return acceptOnly<FlagsT>(std::string_view(name), foldbufs[worker]);
+                });
+            }
+            auto onbatch = [&](DirWalker::Batch& batch)
+            {
+                std::string rawpath;
+                if(sets[batch.worker] == nullptr)
+                {
+                    owned[batch.worker] = std::make_unique<std::vector<Tally>>();
+                    for(const auto& tally: m_tallies)
+                    {
+                        owned[batch.worker]->push_back(tally.worker());
+                    }
+                    sets[batch.worker] = owned[batch.worker].get();
+                }
+                auto& tallies = *sets[batch.worker];
+                // inode numbers roughly follow where the inodes are on disk. only worth it if
+                // every entry gets a stat anyway, which is what it's reordering
+                if(m_options.inodeorder && (m_metafields != 0))
+                {
+                    std::sort(batch.items.begin(), batch.items.end(), [](const auto& a, const auto& b)
+                    {
+                        return (a.ino < b.ino);
+                    });
+                }
+                for(auto& item: batch.items)
+                {
+                    rawpath.assign(batch.dirpath);
+                    if(rawpath.back() != '/')
+                    {
+                        rawpath.push_back('/');
+                    }
+                    rawpath.append(item.name);
+                    std::filesystem::path path(rawpath);
+                    Entry entry(path, batch.dirpath, batch.dirfd, item.name.c_str(), batch.depth);
+                    handler(tallies, entry);
+                }
+            };
+            if(m_options.emitevery > 0)
+            {
+                emitter = std::thread([&]
+                {
+                    std::vector<std::vector<Tally>> copies;
+                    std::unique_lock<std::mutex> guard(emitlock);
+                    while(!emitcond.wait_for(guard, emitInterval(), [&]{ return walked; }))
+                    {
+                        // the walkers are only held back while copying, so every directory is either counted in full, or not at all.
+                        // merging and printing happens once they're running again
+                        dw.whilePaused([&]
+                        {
+                            copies = copiesOf(sets);
+                        });
+                        emitSnapshot(pointersTo(copies));
+                    }
+                });
+            }
+            if(!m_options.checkpointfile.empty())
+            {
+                dw.onCheckpoint(m_options.checkpointevery, [&](const std::vector<DirWalker::Job>& jobs)
+                {
+                    std::lock_guard<std::mutex> guard(errlock);
+                    if(!saveCheckpoint(dirs, jobs, dw, sets))
+                    {
+                        std::cerr << "failed to write checkpoint to '" << m_options.checkpointfile << "': " << std::strerror(errno) << std::endl;
+                        return;
+                    }
+                    verbose("checkpoint: %zu directories left", jobs.size());
+                });
+            }
+            if(m_resume != nullptr)
+            {
+                std::vector<DirWalker::Job> jobs;
+                for(const auto& job: m_resume->pending)
+                {
+                    jobs.push_back(DirWalker::Job{job.path, size_t(job.depth), size_t(job.root)});
+                }
+                dw.resume(dirs, jobs, onbatch);
+            }
+            else
+            {
+                dw.walk(dirs, onbatch);
+            }
+            if(emitter.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> guard(emitlock);
+                    walked = true;
+                }
+                emitcond.notify_all();
+                emitter.join();
+            }
+            for(auto& set: owned)
+            {
+                if(set != nullptr)
+                {
+                    for(size_t i=0; i<set->size(); i++)
+                    {
+                        m_tallies[i].merge((*set)[i]);
+                    }
+                }
+            }
+            if((m_sessioncache == nullptr) && (!m_options.cachefile.empty()))
+            {
+                saveCache(cache);
+            }
+            // the walk is done, so there's nothing left to resume
+            if(!m_options.checkpointfile.empty())
+            {
+                std::remove(m_options.checkpointfile.c_str());
+            }
+        }
+        #endif
+
+        // the sketch options only make sense for a single mode, which main() checks
+        bool loadSketch(const std::string& path)
+        {
+            HyperLogLog other;
+            std::fstream fh(path, std::ios::in | std::ios::binary);
+            if(!fh.good())
+            {
+                std::cerr << "failed to open \"" << path << "\" for reading" << '\n';
+                return false;
+            }
+            if(!other.readFrom(fh))
+            {
+                std::cerr << "\"" << path << "\" is not a valid sketch file" << '\n';
+                return false;
+            }
+            if(!m_tallies[0].sketch().merge(other))
+            {
+                std::cerr << "\"" << path << "\" has a different precision, cannot merge" << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        bool saveSketch(const std::string& path)
+        {
+            std::fstream fh(path, std::ios::out | std::ios::binary);
+            if(!fh.good())
+            {
+                std::cerr << "failed to open '" << path << "' for writing" << '\n';
+                return false;
+            }
+            m_tallies[0].sketch().writeTo(fh);
+            return fh.good();
+        }
+
+        std::chrono::steady_clock::duration emitInterval() const
+        {
+            return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_options.emitevery));
+        }
+
+        /*
+        * the sum of $sets (the tallies of every worker), as it is right now. it's merged into
+        * a fresh set of tallies, so the ones being counted into are left as they are.
+        * with DirWalker, only call this while it's paused (see DirWalker::whilePaused()), or on copiesOf() them.
+        */
+        std::vector<Tally> snapshotOf(const std::vector<std::vector<Tally>*>& sets)
+        {
+            size_t i;
+            size_t w;
+            std::vector<Tally> snapshot;
+            for(const auto& tally: m_tallies)
+            {
+                snapshot.push_back(tally.worker());
+            }
+            for(w=0; w<sets.size(); w++)
+            {
+                if(sets[w] != nullptr)
+                {
+                    for(i=0; i<snapshot.size(); i++)
+                    {
+                        snapshot[i].merge((*sets[w])[i]);
+                    }
+                }
+            }
+            return snapshot;
+        }
+
+        // copies of $sets, as they are right now; cheap compared to merging them, so it's all that's done while DirWalker is paused
+        std::vector<std::vector<Tally>> copiesOf(const std::vector<std::vector<Tally>*>& sets)
+        {
+            std::vector<std::vector<Tally>> res;
+            for(const auto* set: sets)
+            {
+                if(set != nullptr)
+                {
+                    res.emplace_back();
+                    for(const auto& tally: *set)
+                    {
+                        res.back().push_back(tally.copy());
+                    }
+                }
+            }
+            return res;
+        }
+
+        static std::vector<std::vector<Tally>*> pointersTo(std::vector<std::vector<Tally>>& sets)
+        {
+            std::vector<std::vector<Tally>*> res;
+            for(auto& set: sets)
+            {
+                res.push_back(&set);
+            }
+            return res;
+        }
+
+        // '--emit-every': prints snapshotOf($sets)
+        void emitSnapshot(const std::vector<std::vector<Tally>*>& sets)
+        {
+            std::vector<std::unique_lock<std::mutex>> guards;
+            auto snapshot = snapshotOf(sets);
+            // workers may be printing '--stream' keys meanwhile
+            for(auto& tally: m_tallies)
+            {
+                guards.push_back(tally.lockStream());
+            }
+            printTallies(snapshot);
+            out() << std::endl;
+        }
+
+        // for walks that count on the calling thread: emits a snapshot once it's time. called once per directory, or every 1024 lines of a listing
+        void emitIfDue()
+        {
+            if(std::chrono::steady_clock::now() >= m_nextemit)
+            {
+                emitSnapshot({&m_tallies});
+                m_nextemit = (std::chrono::steady_clock::now() + emitInterval());
+            }
+        }
+
+        void printTallies(std::vector<Tally>& tallies)
+        {
+            size_t i;
+            size_t printed;
+            printed = 0;
+            for(i=0; i<tallies.size(); i++)
+            {
+                // '--stream' has printed its keys while walking, so it has neither a result nor a header
+                if(tallies[i].sinkKind() == SinkKind::Stream)
+                {
+                    continue;
+                }
+                // with several modes, each result gets a header, and a blank line in between
+                if(tallies.size() > 1)
+                {
+                    if(printed++ > 0)
+                    {
+                        out() << '\n';
+                    }
+                    out() << "[" << sortKindName(tallies[i].kind()) << "]" << '\n';
+                }
+                tallies[i].printOutput();
+            }
+        }
+
+        void printOutput()
+        {
+            printTallies(m_tallies);
+        }
+};
+
+static int64_t nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*
+* parses a point in time for '--newer', in nanoseconds since the epoch:
+*   "@1700000000" or "1700000000": seconds since the epoch
+*   "2024-01-31", "2024-01-31 12:00", "2024-01-31T12:00:30": local time
+*   anything else is taken as a file, whose modification time is used (like find -newer)
+*/
+static bool parseTimestamp(const std::string& str, int64_t& dest)
+{
+    int n;
+    std::tm tm = {};
+    std::time_t secs;
+    std::string digits;
+    digits = ((!str.empty() && (str[0] == '@')) ? str.substr(1) : str);
+    if(!digits.empty() && std::all_of(digits.begin(), digits.end(), ::isdigit))
+    {
+        dest = (std::stoll(digits) * 1000000000);
+        return true;
+    }
+    n = std::sscanf(str.c_str(), "%d-%d-%d%*[ T]%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if((n == 3) || (n >= 5))
+    {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        secs = std::mktime(&tm);
+        if(secs == std::time_t(-1))
+        {
+            return false;
+        }
+        dest = (int64_t(secs) * 1000000000);
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::path path(str);
+    if(std::filesystem::exists(path, ec))
+    {
+        Entry entry(path);
+        dest = entry.mtime();
+        return true;
+    }
+    return false;
+}
+
+/*
+* for '--gentle': idle i/o priority (which only gets disk time nobody else wants), and the
+* lowest cpu priority. both are inherited by threads started afterwards, so this has to
+* happen before the walk.
+*/
+static void lowerPriority()
+{
+    #if defined(COE_ISLINUX)
+        // glibc has no wrapper for ioprio_set; this is IOPRIO_WHO_PROCESS, and IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+        if(syscall(SYS_ioprio_set, 1, 0, (3 << 13)) != 0)
+        {
+            std::cerr << "warning: failed to set idle i/o priority: " << std::strerror(errno) << std::endl;
+        }
+    #endif
+    #if defined(COE_ISUNIXLIKE)
+        if(setpriority(PRIO_PROCESS, 0, 19) != 0)
+        {
+            std::cerr << "warning: failed to lower cpu priority: " << std::strerror(errno) << std::endl;
+        }
+    #else
+        std::cerr << "warning: '--gentle' can not lower priorities on this platform" << std::endl;
+    #endif
+}
+
+/*
+* for some reason, isatty() seems to not work... sometimes.
+* haven't been able to figure out why, yet.
+* works so far with msvc, clang (for msvc), and gcc.
+*/
+static bool have_filepipe()
+{
+    return (isatty(fileno(stdin)) == 0);
+}
 
 int main(int argc, char* argv[])
 {
@@ -532,35 +3851,296 @@ int main(int argc, char* argv[])
         opts.outstream = fhptr;
         opts.mustclose = true;
     });
-    prs.on({"-m?", "--mode=?"}, "which sort kind to use ('e': extension, 's': stem, 'f': filename. default: 'e')", [&](const auto& v)
+    prs.on({"-m?", "--mode=?"}, "which sort kind(s) to use, comma-separated ('e': extension, 's': stem, 'f': filename, 'l': language, 'size': bytes and size percentiles per extension, 'rollup': files and bytes per directory subtree, 'depth': extensions per directory depth, 'age': extensions by modification age, 'owner': files and bytes per user and extension. default: 'e')", [&](const auto& v)
     {
-        char modech;
+        size_t pos;
+        size_t next;
+        SortKind kind;
+        std::string name;
         auto s = v.str();
-        modech = std::tolower(s[0]);
-        switch(modech)
-        {
-            case 'x':
-            case 'e':
-                opts.sortkind = SortKind::Extension;
-                break;
-            case 'f': // 'filename'
-            case 'b': // 'basename'
-                opts.sortkind = SortKind::Filename;
-                break;
-            case 'n': // 'name'
-            case 's': // 'stem'
-                opts.sortkind = SortKind::Stem;
-                break;
-            default:
-                std::cerr << "unknown mode '" << modech << "'" << std::endl;
-                std::exit(1);
-                break;
+        opts.sortkinds.clear();
+        pos = 0;
+        while(pos <= s.size())
+        {
+            next = s.find(',', pos);
+            if(next == std::string::npos)
+            {
+                next = s.size();
+            }
+            name = s.substr(pos, next - pos);
+            pos = (next + 1);
+            if(name.empty())
+            {
+                continue;
+            }
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            // 'size' has to be checked in full, since 's' is 'stem'
+            if((name == "size") || (name == "z"))
+            {
+                kind = SortKind::Size;
+            }
+            else if(name == "du")
+            {
+                kind = SortKind::Rollup;
+            }
+            else if(name == "age")
+            {
+                kind = SortKind::Age;
+            }
+            else
+            {
+                switch(name[0])
+                {
+                    case 'x':
+                    case 'e':
+                        kind = SortKind::Extension;
+                        break;
+                    case 'f': // 'filename'
+                    case 'b': // 'basename'
+                        kind = SortKind::Filename;
+                        break;
+                    case 'n': // 'name'
+                    case 's': // 'stem'
+                        kind = SortKind::Stem;
+                        break;
+                    case 'l': // 'language'
+                        kind = SortKind::Language;
+                        break;
+                    case 'r': // 'rollup'
+                        kind = SortKind::Rollup;
+                        break;
+                    case 'd': // 'depth'
+                        kind = SortKind::Depth;
+                        break;
+                    case 'a': // 'age'
+                        kind = SortKind::Age;
+                        break;
+                    case 'o': // 'owner'
+                    case 'u': // 'user'
+                        kind = SortKind::Owner;
+                        break;
+                    default:
+                        std::cerr << "unknown mode '" << name << "'" << std::endl;
+                        std::exit(1);
+                        break;
+                }
+            }
+            if(std::find(opts.sortkinds.begin(), opts.sortkinds.end(), kind) == opts.sortkinds.end())
+            {
+                opts.sortkinds.push_back(kind);
+            }
+        }
+        if(opts.sortkinds.empty())
+        {
+            std::cerr << "no mode given" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"--only=?"}, "only count files with one of these extensions (comma-separated, e.g. '.log,.tmp')", [&](const auto& v)
+    {
+        size_t pos;
+        size_t next;
+        std::string ext;
+        auto s = v.str();
+        pos = 0;
+        while(pos <= s.size())
+        {
+            next = s.find(',', pos);
+            if(next == std::string::npos)
+            {
+                next = s.size();
+            }
+            ext = s.substr(pos, next - pos);
+            if(!ext.empty())
+            {
+                if(ext[0] != '.')
+                {
+                    ext.insert(0, ".");
+                }
+                opts.onlyexts.push_back(ext);
+            }
+            pos = (next + 1);
+        }
+        if(opts.onlyexts.size() > OnlySet::capacity)
+        {
+            std::cerr << "'--only' takes at most " << OnlySet::capacity << " extensions" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"--newer=?"}, "only count files modified after this time (seconds since the epoch, 'YYYY-MM-DD[ HH:MM[:SS]]', or a file to compare against)", [&](const auto& v)
+    {
+        auto s = v.str();
+        if(!parseTimestamp(s, opts.newerthan))
+        {
+            std::cerr << "'--newer': cannot parse '" << s << "' as a time, and it's not a file either" << std::endl;
+            std::exit(1);
         }
+        opts.havenewer = true;
+    });
+    prs.on({"--unique-inodes"}, "count files with several hard links only once", [&]
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.uniqueinodes = true;
+        #else
+            std::cerr << "warning: '--unique-inodes' is not supported on this platform" << std::endl;
+        #endif
     });
     prs.on({"-x", "--collect"}, "collect file modes (extension or otherwise) only, does not print amount", [&]
     {
         opts.collectonly = true;
     });
+    prs.on({"--stream"}, "like '--collect', but print each key as soon as it is first seen, instead of after the walk", [&]
+    {
+        opts.collectonly = true;
+        opts.streamcollect = true;
+    });
+    prs.on({"-k?", "--approx=?"}, "approximate counting: keep only the N most frequent keys, with error bounds (Space-Saving)", [&](const auto& v)
+    {
+        opts.approxcount = v.template as<size_t>();
+        if(opts.approxcount == 0)
+        {
+            std::cerr << "--approx needs a counter amount larger than 0" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"-u", "--cardinality"}, "only estimate the amount of distinct keys (HyperLogLog), do not list them", [&]
+    {
+        opts.cardinality = true;
+    });
+    prs.on({"--sketch-load=?"}, "merge a sketch saved by an earlier '--cardinality' run into the estimate", [&](const auto& v)
+    {
+        opts.sketchload.push_back(v.str());
+    });
+    prs.on({"--sketch-save=?"}, "save the '--cardinality' sketch to a file, for merging later", [&](const auto& v)
+    {
+        opts.sketchsave = v.str();
+    });
+    prs.on({"-j?", "--jobs=?"}, "walk directories with this many threads (default: 1; per device with '--per-device'), or 'auto' to tune by storage type", [&](const auto& v)
+    {
+        if(v.str() == "auto")
+        {
+            // the upper bound. what's actually used is decided per device
+            opts.autojobs = true;
+            opts.jobs = std::min(size_t(32), std::max(size_t(16), size_t(std::thread::hardware_concurrency()) * 2));
+        }
+        else
+        {
+            opts.jobs = v.template as<size_t>();
+        }
+        if(opts.jobs == 0)
+        {
+            opts.jobs = std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+        }
+        #if !defined(COE_ISUNIXLIKE)
+            std::cerr << "warning: '--jobs' is not supported on this platform, using 1" << std::endl;
+            opts.jobs = 1;
+            opts.autojobs = false;
+        #endif
+    });
+    prs.on({"-L", "--follow"}, "follow symlinked directories (each directory is still only counted once)", [&]
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.follow = true;
+        #else
+            std::cerr << "warning: '--follow' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--one-file-system"}, "do not descend into directories on other filesystems (like find -xdev)", [&]
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.onefs = true;
+        #else
+            std::cerr << "warning: '--one-file-system' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--per-device"}, "walk roots (and mount points) on different devices at the same time, each with its own '--jobs' workers", [&]
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.perdevice = true;
+        #else
+            std::cerr << "warning: '--per-device' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--inode-order"}, "stat entries in inode order (faster on spinning disks with modes that need sizes, times or owners)", [&]
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.inodeorder = true;
+        #else
+            std::cerr << "warning: '--inode-order' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--cache=?"}, "keep directory listings in this file, and only read directories that changed since", [&](const auto& v)
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.cachefile = v.str();
+        #else
+            std::cerr << "warning: '--cache' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--watch=?"}, "after counting, keep counting changes; print every this many seconds (0: only on SIGUSR1), and once more on exit", [&](const auto& v)
+    {
+        #if defined(COE_ISLINUX)
+            opts.watch = true;
+            opts.watchinterval = v.template as<double>();
+        #else
+            (void)v;
+            std::cerr << "warning: '--watch' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--emit-every=?"}, "while walking, print what's been counted so far every this many seconds", [&](const auto& v)
+    {
+        opts.emitevery = v.template as<double>();
+    });
+    prs.on({"--checkpoint=?"}, "save the walk to this file every so often, so '--resume' can continue it; removed once the walk is done", [&](const auto& v)
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.checkpointfile = v.str();
+        #else
+            std::cerr << "warning: '--checkpoint' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--checkpoint-every=?"}, "how many seconds apart checkpoints are saved (default: 60)", [&](const auto& v)
+    {
+        opts.checkpointevery = v.template as<double>();
+        if(opts.checkpointevery <= 0)
+        {
+            std::cerr << "error: '--checkpoint-every' must be above 0" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"--resume=?"}, "continue the walk saved in this checkpoint file (with the same options), and keep checkpointing to it", [&](const auto& v)
+    {
+        #if defined(COE_ISUNIXLIKE)
+            opts.resumefile = v.str();
+        #else
+            std::cerr << "warning: '--resume' is not supported on this platform" << std::endl;
+        #endif
+    });
+    prs.on({"--gentle"}, "run at idle i/o and cpu priority, and read at most 500 directories per second (unless '--max-rate' says otherwise)", [&]
+    {
+        opts.gentle = true;
+    });
+    prs.on({"--max-rate=?"}, "read at most this many directories per second", [&](const auto& v)
+    {
+        opts.maxrate = v.template as<double>();
+        if(opts.maxrate <= 0)
+        {
+            std::cerr << "error: '--max-rate' must be above 0" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"--top=?"}, "how many subtrees '--mode=rollup' prints (default: 20)", [&](const auto& v)
+    {
+        opts.topcount = v.template as<size_t>();
+    });
+    prs.on({"--histogram"}, "with '--mode=size', also print each extension's log2 size histogram", [&]
+    {
+        opts.printhistogram = true;
+    });
+    prs.on({"--json"}, "print '--mode=depth' and '--mode=age' as a JSON matrix", [&]
+    {
+        opts.jsonoutput = true;
+    });
     prs.on({"-v", "--verbose"}, "enable verbose messages", [&]
     {
         opts.verbose = true;
@@ -573,10 +4153,67 @@ int main(int argc, char* argv[])
     {
         std::cerr << "error: " << e.what() << '\n';
     }
+    if((opts.sortkinds.size() > 1) && ((!opts.sketchload.empty()) || (!opts.sketchsave.empty())))
+    {
+        std::cerr << "error: '--sketch-load' and '--sketch-save' only work with a single mode" << '\n';
+        return 1;
+    }
+    if(opts.watch)
+    {
+        // removed files can't be stat()'d anymore, so only what's in their names can be taken back out
+        for(auto kind: opts.sortkinds)
+        {
+            if((kind != SortKind::Extension) && (kind != SortKind::Stem) && (kind != SortKind::Filename) && (kind != SortKind::Language))
+            {
+                std::cerr << "error: '--watch' only works with the extension, stem, filename and language modes" << '\n';
+                return 1;
+            }
+        }
+        if(opts.streamcollect || opts.cardinality || (opts.approxcount > 0) || opts.havenewer || opts.uniqueinodes || (opts.maxdepth > 0) || opts.readstdin || opts.readlistings)
+        {
+            std::cerr << "error: '--watch' can not be combined with '--stream', approximate counting, '--newer', '--unique-inodes', '--maxdepth', '--stdin' or '--listing'" << '\n';
+            return 1;
+        }
+    }
+    if((!opts.checkpointfile.empty()) || (!opts.resumefile.empty()))
+    {
+        // '--stream' has printed what it's seen by the time a checkpoint is saved
+        if(opts.streamcollect || opts.watch || opts.readstdin || opts.readlistings)
+        {
+            std::cerr << "error: '--checkpoint' and '--resume' can not be combined with '--stream', '--watch', '--stdin' or '--listing'" << '\n';
+            return 1;
+        }
+        if(opts.checkpointfile.empty())
+        {
+            opts.checkpointfile = opts.resumefile;
+        }
+    }
+    if(opts.gentle)
+    {
+        lowerPriority();
+        if(opts.maxrate == 0)
+        {
+            opts.maxrate = 500;
+        }
+    }
+    opts.starttime = nowNanos();
     CountFiles cf(opts);
-    if((!opts.readstdin) && (prs.size() == 0))
+    if(!opts.resumefile.empty())
+    {
+        #if defined(COE_ISUNIXLIKE)
+            if(!prs.positional().empty())
+            {
+                std::cerr << "warning: with '--resume', the directories are the ones in the checkpoint" << std::endl;
+            }
+            if(!cf.resumeDirectories(opts.resumefile))
+            {
+                return 1;
+            }
+        #endif
+    }
+    else if((!opts.readstdin) && (prs.size() == 0))
     {
-        cf.walkDirectory(".");
+        cf.countDirectories({"."});
     }
     else
     {
@@ -612,10 +4249,28 @@ int main(int argc, char* argv[])
         }
         else
         {
-            auto dirs = prs.positional();
-            for(const auto& dir: dirs)
+            std::vector<std::string> dirs;
+            for(const auto& dir: prs.positional())
+            {
+                dirs.push_back(dir);
+            }
+            cf.countDirectories(dirs);
+        }
+    }
+    if(opts.cardinality)
+    {
+        for(const auto& file: opts.sketchload)
+        {
+            if(!cf.loadSketch(file))
+            {
+                return 1;
+            }
+        }
+        if(!opts.sketchsave.empty())
+        {
+            if(!cf.saveSketch(opts.sketchsave))
             {
-                cf.walkDirectory(dir);
+                return 1;
             }
         }
     }
@@ -0,0 +1,557 @@
+
+/*
+* approximate counting structures, for when the exact ExtList would
+* grow past what fits into memory.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+#include "binio.h"
+
+/*
+* Space-Saving (Metwally, Agrawal, El Abbadi; 2005).
+* keeps at most $capacity counters. when a new key shows up and all counters are in use,
+* the key with the smallest count is evicted, and the new key inherits its count (+1).
+* the inherited amount is stored as `error`, so for every reported key the true count
+* lies within [count - error, count]. any key that occurs more than (total / capacity)
+* times is guaranteed to be present.
+*/
+class SpaceSaving
+{
+    public:
+        struct Item
+        {
+            std::string ext;
+            size_t count;
+            size_t error;
+        };
+
+    private:
+        size_t m_capacity;
+        size_t m_total = 0;
+        std::vector<Item> m_items;
+        // min-heap over indices into m_items, ordered by count
+        std::vector<size_t> m_heap;
+        // m_heappos[i] is where m_items[i] currently sits in m_heap
+        std::vector<size_t> m_heappos;
+        std::unordered_map<std::string, size_t> m_index;
+
+    private:
+        bool heapLess(size_t a, size_t b) const
+        {
+            return (m_items[m_heap[a]].count < m_items[m_heap[b]].count);
+        }
+
+        void heapSwap(size_t a, size_t b)
+        {
+            std::swap(m_heap[a], m_heap[b]);
+            m_heappos[m_heap[a]] = a;
+            m_heappos[m_heap[b]] = b;
+        }
+
+        void siftUp(size_t pos)
+        {
+            size_t parent;
+            while(pos > 0)
+            {
+                parent = ((pos - 1) / 2);
+                if(!heapLess(pos, parent))
+                {
+                    break;
+                }
+                heapSwap(pos, parent);
+                pos = parent;
+            }
+        }
+
+        // counts only ever go up, so an item can only ever move towards the leaves
+        void siftDown(size_t pos)
+        {
+            size_t left;
+            size_t right;
+            size_t smallest;
+            while(true)
+            {
+                left = ((pos * 2) + 1);
+                right = (left + 1);
+                smallest = pos;
+                if((left < m_heap.size()) && heapLess(left, smallest))
+                {
+                    smallest = left;
+                }
+                if((right < m_heap.size()) && heapLess(right, smallest))
+                {
+                    smallest = right;
+                }
+                if(smallest == pos)
+                {
+                    break;
+                }
+                heapSwap(pos, smallest);
+                pos = smallest;
+            }
+        }
+
+        // rebuilds the index and the heap after m_items was replaced as a whole
+        void rebuild()
+        {
+            size_t i;
+            m_index.clear();
+            m_heap.resize(m_items.size());
+            m_heappos.resize(m_items.size());
+            for(i=0; i<m_items.size(); i++)
+            {
+                m_index.emplace(m_items[i].ext, i);
+                m_heap[i] = i;
+                m_heappos[i] = i;
+            }
+            for(i=(m_heap.size() / 2); i-- > 0;)
+            {
+                siftDown(i);
+            }
+        }
+
+    public:
+        SpaceSaving(size_t capacity): m_capacity(capacity)
+        {
+        }
+
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        size_t size() const
+        {
+            return m_items.size();
+        }
+
+        // total amount of keys seen so far (including evicted ones)
+        size_t total() const
+        {
+            return m_total;
+        }
+
+        // smallest count currently held. any key not in the list occurred at most this many times.
+        size_t minCount() const
+        {
+            if(m_heap.empty() || (m_items.size() < m_capacity))
+            {
+                return 0;
+            }
+            return m_items[m_heap[0]].count;
+        }
+
+        // a copy of the counters. sorting them in place would break the heap.
+        std::vector<Item> items() const
+        {
+            return m_items;
+        }
+
+        /*
+        * merges another summary into this one (Agarwal et al., "Mergeable Summaries"; 2012):
+        * a key missing from one side may have been evicted there, so it's credited with that
+        * side's smallest count - as both count, and error. the largest $capacity counters are kept.
+        */
+        void merge(const SpaceSaving& other)
+        {
+            size_t ownmin;
+            size_t othermin;
+            std::vector<Item> merged;
+            ownmin = minCount();
+            othermin = other.minCount();
+            merged = m_items;
+            for(auto& item: merged)
+            {
+                auto it = other.m_index.find(item.ext);
+                if(it != other.m_index.end())
+                {
+                    item.count += other.m_items[it->second].count;
+                    item.error += other.m_items[it->second].error;
+                }
+                else
+                {
+                    item.count += othermin;
+                    item.error += othermin;
+                }
+            }
+            for(const auto& item: other.m_items)
+            {
+                if(m_index.find(item.ext) == m_index.end())
+                {
+                    merged.push_back(Item{item.ext, item.count + ownmin, item.error + ownmin});
+                }
+            }
+            if(merged.size() > m_capacity)
+            {
+                std::nth_element(merged.begin(), merged.begin() + m_capacity, merged.end(), [](const Item& lhs, const Item& rhs)
+                {
+                    return (lhs.count > rhs.count);
+                });
+                merged.resize(m_capacity);
+            }
+            m_total += other.m_total;
+            m_items = std::move(merged);
+            rebuild();
+        }
+
+        // the counters and the total; the capacity is up to whoever reads it back
+        void writeTo(std::ostream& os) const
+        {
+            BinIO::writeVal(os, uint64_t(m_total));
+            BinIO::writeVal(os, uint64_t(m_items.size()));
+            for(const auto& item: m_items)
+            {
+                BinIO::writeString(os, item.ext);
+                BinIO::writeVal(os, uint64_t(item.count));
+                BinIO::writeVal(os, uint64_t(item.error));
+            }
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            uint64_t total;
+            uint64_t count;
+            uint64_t error;
+            uint64_t nitems;
+            std::vector<Item> items;
+            if(!BinIO::readVal(is, total) || !BinIO::readVal(is, nitems) || (nitems > m_capacity))
+            {
+                return false;
+            }
+            while(nitems-- > 0)
+            {
+                std::string ext;
+                if(!BinIO::readString(is, ext, (uint64_t(1) << 20)) || !BinIO::readVal(is, count) || !BinIO::readVal(is, error))
+                {
+                    return false;
+                }
+                items.push_back(Item{std::move(ext), size_t(count), size_t(error)});
+            }
+            m_total = total;
+            m_items = std::move(items);
+            rebuild();
+            return true;
+        }
+
+        void increase(const std::string& ext)
+        {
+            size_t idx;
+            auto it = m_index.find(ext);
+            m_total++;
+            if(it != m_index.end())
+            {
+                idx = it->second;
+                m_items[idx].count++;
+                siftDown(m_heappos[idx]);
+            }
+            else if(m_items.size() < m_capacity)
+            {
+                idx = m_items.size();
+                m_items.push_back(Item{ext, 1, 0});
+                m_heap.push_back(idx);
+                m_heappos.push_back(m_heap.size() - 1);
+                m_index.emplace(ext, idx);
+                siftUp(m_heap.size() - 1);
+            }
+            else if(m_capacity > 0)
+            {
+                // evict the smallest counter, and take over its count as error
+                idx = m_heap[0];
+                auto& victim = m_items[idx];
+                m_index.erase(victim.ext);
+                victim.ext = ext;
+                victim.error = victim.count;
+                victim.count++;
+                m_index.emplace(ext, idx);
+                siftDown(0);
+            }
+        }
+};
+
+/*
+* HyperLogLog (Flajolet, Fusy, Gandouet, Meunier; 2007).
+* estimates the amount of distinct keys using 2^precision one-byte registers - with the
+* default precision of 14 that's 16kb, at a standard error of about 0.8%.
+* two sketches of the same precision can be merged, which yields exactly the sketch
+* that would have been built had both inputs been fed into one. since the hash function
+* is fixed (i.e., not std::hash), saved sketches stay mergeable across runs and machines.
+*/
+class HyperLogLog
+{
+    public:
+        static constexpr uint8_t defaultPrecision = 14;
+
+    private:
+        static constexpr char fileMagic[8] = {'C', 'X', 'H', 'L', 'L', '0', '0', '1'};
+
+    private:
+        uint8_t m_precision;
+        std::vector<uint8_t> m_registers;
+
+    public:
+        // FNV-1a, followed by the murmur3 finalizer to spread the bits around
+        static uint64_t hashKey(const char* str, size_t len)
+        {
+            size_t i;
+            uint64_t h;
+            h = 0xcbf29ce484222325ULL;
+            for(i=0; i<len; i++)
+            {
+                h ^= uint8_t(str[i]);
+                h *= 0x100000001b3ULL;
+            }
+            h ^= (h >> 33);
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= (h >> 33);
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= (h >> 33);
+            return h;
+        }
+
+    public:
+        HyperLogLog(uint8_t precision=defaultPrecision): m_precision(precision), m_registers(size_t(1) << precision, 0)
+        {
+        }
+
+        uint8_t precision() const
+        {
+            return m_precision;
+        }
+
+        void add(const std::string& key)
+        {
+            addHash(hashKey(key.data(), key.size()));
+        }
+
+        void addHash(uint64_t hash)
+        {
+            size_t idx;
+            uint8_t rank;
+            uint64_t rest;
+            idx = (hash >> (64 - m_precision));
+            // position of the first 1-bit in the remaining bits. the sentinel bit
+            // caps the rank in case all remaining bits are zero.
+            rest = ((hash << m_precision) | (uint64_t(1) << (m_precision - 1)));
+            rank = 1;
+            while((rest & (uint64_t(1) << 63)) == 0)
+            {
+                rank++;
+                rest <<= 1;
+            }
+            if(rank > m_registers[idx])
+            {
+                m_registers[idx] = rank;
+            }
+        }
+
+        bool merge(const HyperLogLog& other)
+        {
+            size_t i;
+            if(other.m_precision != m_precision)
+            {
+                return false;
+            }
+            for(i=0; i<m_registers.size(); i++)
+            {
+                m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+            }
+            return true;
+        }
+
+        double estimate() const
+        {
+            size_t zeros;
+            double m;
+            double sum;
+            double alpha;
+            double est;
+            m = double(m_registers.size());
+            sum = 0;
+            zeros = 0;
+            for(auto reg: m_registers)
+            {
+                sum += std::ldexp(1.0, -int(reg));
+                if(reg == 0)
+                {
+                    zeros++;
+                }
+            }
+            alpha = (0.7213 / (1.0 + (1.079 / m)));
+            est = ((alpha * m * m) / sum);
+            // small range correction: linear counting is far more accurate while registers are still empty
+            if((est <= (2.5 * m)) && (zeros > 0))
+            {
+                est = (m * std::log(m / double(zeros)));
+            }
+            return est;
+        }
+
+        // relative standard error of estimate()
+        double stdError() const
+        {
+            return (1.04 / std::sqrt(double(m_registers.size())));
+        }
+
+        void writeTo(std::ostream& os) const
+        {
+            os.write(fileMagic, sizeof(fileMagic));
+            os.put(char(m_precision));
+            os.write(reinterpret_cast<const char*>(m_registers.data()), m_registers.size());
+        }
+
+        bool readFrom(std::istream& is)
+        {
+            char magic[sizeof(fileMagic)];
+            int prec;
+            if(!is.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), fileMagic))
+            {
+                return false;
+            }
+            prec = is.get();
+            if((prec < 4) || (prec > 18))
+            {
+                return false;
+            }
+            m_precision = uint8_t(prec);
+            m_registers.assign(size_t(1) << m_precision, 0);
+            return bool(is.read(reinterpret_cast<char*>(m_registers.data()), m_registers.size()));
+        }
+};
+
+/*
+* a histogram of sizes over 64 power-of-two buckets: bucket b holds sizes in [2^b, 2^(b+1)),
+* plus 0 in bucket 0. only non-empty buckets take up space - `m_mask` says which ones are
+* there, and `m_counts` holds their counters in bucket order. most keys only ever hit a
+* dozen or so buckets, so this is a lot smaller than 64 counters per key.
+* merging is exact, since the bucket bounds are fixed.
+*/
+class SizeHistogram
+{
+    public:
+        static constexpr size_t bucketcount = 64;
+
+    private:
+        uint64_t m_mask = 0;
+        std::vector<uint64_t> m_counts;
+
+    private:
+        static size_t popCount(uint64_t v)
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+                return __builtin_popcountll(v);
+            #else
+                size_t res;
+                for(res=0; v!=0; res++)
+                {
+                    v &= (v - 1);
+                }
+                return res;
+            #endif
+        }
+
+        // where bucket $b sits in m_counts - whether it's there or not
+        size_t slotOf(size_t b) const
+        {
+            return popCount(m_mask & ((uint64_t(1) << b) - 1));
+        }
+
+    public:
+        static size_t bucketOf(uint64_t size)
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+                return (63 - __builtin_clzll(size | 1));
+            #else
+                size_t res;
+                res = 0;
+                while(size > 1)
+                {
+                    size >>= 1;
+                    res++;
+                }
+                return res;
+            #endif
+        }
+
+        uint64_t at(size_t b) const
+        {
+            if((m_mask & (uint64_t(1) << b)) == 0)
+            {
+                return 0;
+            }
+            return m_counts[slotOf(b)];
+        }
+
+        bool empty() const
+        {
+            return (m_mask == 0);
+        }
+
+        void addBucket(size_t b, uint64_t count)
+        {
+            size_t slot;
+            slot = slotOf(b);
+            if((m_mask & (uint64_t(1) << b)) == 0)
+            {
+                m_mask |= (uint64_t(1) << b);
+                m_counts.insert(m_counts.begin() + slot, 0);
+            }
+            m_counts[slot] += count;
+        }
+
+        void add(uint64_t size)
+        {
+            addBucket(bucketOf(size), 1);
+        }
+
+        void merge(const SizeHistogram& other)
+        {
+            size_t b;
+            for(b=0; b<bucketcount; b++)
+            {
+                if((other.m_mask & (uint64_t(1) << b)) != 0)
+                {
+                    addBucket(b, other.at(b));
+                }
+            }
+        }
+
+        uint64_t total() const
+        {
+            uint64_t res;
+            res = 0;
+            for(auto c: m_counts)
+            {
+                res += c;
+            }
+            return res;
+        }
+
+        // the bucket that the $q-quantile (0 < q <= 1) falls into
+        size_t quantileBucket(double q) const
+        {
+            size_t b;
+            uint64_t seen;
+            uint64_t want;
+            want = uint64_t(std::ceil(q * double(total())));
+            seen = 0;
+            for(b=0; b<bucketcount; b++)
+            {
+                seen += at(b);
+                if((seen >= want) && (seen > 0))
+                {
+                    return b;
+                }
+            }
+            return (bucketcount - 1);
+        }
+};
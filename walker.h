@@ -0,0 +1,831 @@
+
+/*
+* a directory walker for unix-like platforms, built directly on openat()/readdir().
+* directories are handed out to a pool of worker threads through a shared queue,
+* and read as a whole, so the callback gets one batch of entries per directory
+* (along with the directory's fd, for anything that wants to fstatat() relative to it).
+*
+* with setPerDevice(), there is one such pool per device instead: roots, and mount points
+* found along the way, go to the pool of the device they're on. every pool has its own
+* '--jobs' workers, so a slow disk can't hold up the others.
+*
+* with setAdaptive(), the amount of workers that may read at the same time starts at what
+* suggestJobs() thinks suits the storage (without setPerDevice(), the slowest storage of all
+* roots), and is adjusted along the way by how long directories take to read - setJobs() is
+* then just the upper bound.
+*
+* with setCache(), directories that haven't changed since the DirCache last saw them are
+* not read at all; their entries come from the cache instead.
+*
+* with onCheckpoint(), the walk is paused every so often, once no worker is in the middle of
+* a directory, and the callback gets the directories that are still queued. resume() later
+* picks up from there. whilePaused() does the same on demand, from any other thread.
+*
+* Find::Finder remains what's used by default; this is what '--jobs' runs on.
+*/
+
+#pragma once
+
+#include "glue.h"
+#include "dircache.h"
+
+#if defined(COE_ISUNIXLIKE)
+
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <set>
+#include <utility>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <dirent.h>
+#if defined(COE_ISLINUX)
+    #include <sys/vfs.h>
+    #include <sys/sysmacros.h>
+#endif
+
+class DirWalker
+{
+    public:
+        // devices beyond this many share the first pool
+        static constexpr size_t maxpools = 16;
+
+        struct Item
+        {
+            std::string name;
+            ino_t ino;
+            // d_type, or DT_UNKNOWN if the filesystem doesn't fill it in
+            unsigned char type;
+        };
+
+        // a directory that's yet to be read
+        struct Job
+        {
+            std::string path;
+            size_t depth;
+            // index into the roots given to walk()
+            size_t root;
+        };
+
+        // everything that isn't a directory, from one directory
+        struct Batch
+        {
+            // the worker that read this batch, in [0, maxWorkers())
+            size_t worker;
+            int dirfd;
+            const std::string& dirpath;
+            // depth of the directory itself; the walk root is at 0
+            size_t depth;
+            std::vector<Item>& items;
+        };
+
+        using PruneFunc = std::function<bool(const std::string&)>;
+        // called with the reading worker (see Batch::worker), and the name of a file; see acceptIf()
+        using AcceptFunc = std::function<bool(size_t, const char*)>;
+        using DirFunc = std::function<void(const std::string&)>;
+        // called with the walk root that $path is under, the path, and errno
+        using ErrorFunc = std::function<void(const std::string&, const std::string&, int)>;
+        // called with a directory on the device, and the new amount of workers; see setAdaptive()
+        using TuneFunc = std::function<void(const std::string&, size_t)>;
+        // called with every queued directory, while the walk is paused; see onCheckpoint()
+        using CheckpointFunc = std::function<void(const std::vector<Job>&)>;
+
+    private:
+        struct Pool
+        {
+            dev_t dev;
+            std::deque<Job> queue;
+            // this pool's workers are numbered [firstworker, firstworker + m_jobs)
+            size_t firstworker;
+            // how many of them may be reading at the same time, and how many are
+            size_t limit;
+            size_t active = 0;
+            // where this pool started; only for TuneFunc
+            std::string path;
+            // per-directory read latency: the best average seen so far, and the current window
+            double baseline = 0;
+            double windowsum = 0;
+            size_t windowsize = 0;
+        };
+
+        enum class Kind
+        {
+            File,
+            Directory,
+            // a symlink to a directory - which, like with Finder, is neither listed nor entered (unless setFollow())
+            LinkedDirectory,
+        };
+
+    private:
+        size_t m_jobs = 1;
+        size_t m_maxdepth = 0;
+        bool m_follow = false;
+        bool m_onefs = false;
+        bool m_perdevice = false;
+        bool m_adaptive = false;
+        PruneFunc m_prunefn;
+        AcceptFunc m_acceptfn;
+        DirFunc m_dirfn;
+        ErrorFunc m_errorfn;
+        TuneFunc m_tunefn;
+        CheckpointFunc m_checkfn;
+        DirCache* m_cache = nullptr;
+
+        std::vector<std::string> m_roots;
+        // st_dev of each root; see setOneFileSystem()
+        std::vector<dev_t> m_rootdevs;
+
+        std::mutex m_lock;
+        std::condition_variable m_cond;
+        // a deque, so that pools stay put while new ones are added
+        std::deque<Pool> m_pools;
+        // threads started by pools created during the walk
+        std::vector<std::thread> m_threads;
+        // jobs in all queues, and workers currently reading a directory.
+        // the walk is done once both are zero.
+        size_t m_queued = 0;
+        size_t m_busy = 0;
+        // with onCheckpoint(): whether workers are held back until the checkpoint is taken, and when the next one is due
+        bool m_pausing = false;
+        // callers of whilePaused() that are waiting, or running; workers are held back meanwhile as well
+        size_t m_pauses = 0;
+        std::chrono::steady_clock::duration m_checkevery{};
+        std::chrono::steady_clock::time_point m_nextcheck;
+
+        // with setFollow(), every directory read so far, as (st_dev, st_ino)
+        std::mutex m_visitlock;
+        std::set<std::pair<dev_t, ino_t>> m_visited;
+
+    private:
+        static std::string joinPath(const std::string& dir, const char* name)
+        {
+            std::string res;
+            res.reserve(dir.size() + std::strlen(name) + 1);
+            res.append(dir);
+            if(res.empty() || (res.back() != '/'))
+            {
+                res.push_back('/');
+            }
+            res.append(name);
+            return res;
+        }
+
+        Kind kindOf(int dirfd, const char* name, unsigned char type)
+        {
+            struct stat st;
+            if(type == DT_UNKNOWN)
+            {
+                if(fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                {
+                    return Kind::File;
+                }
+                if(S_ISDIR(st.st_mode))
+                {
+                    return Kind::Directory;
+                }
+                type = (S_ISLNK(st.st_mode) ? DT_LNK : DT_REG);
+            }
+            if(type == DT_DIR)
+            {
+                return Kind::Directory;
+            }
+            if(type == DT_LNK)
+            {
+                if((fstatat(dirfd, name, &st, 0) == 0) && S_ISDIR(st.st_mode))
+                {
+                    return Kind::LinkedDirectory;
+                }
+            }
+            return Kind::File;
+        }
+
+        // the pool for $dev (which $path is on), created and started if need be. m_lock must be held.
+        template<typename BatchFuncT>
+        Pool& poolFor(dev_t dev, const std::string& path, BatchFuncT& fn)
+        {
+            size_t limit;
+            size_t i;
+            for(auto& pool: m_pools)
+            {
+                if(pool.dev == dev)
+                {
+                    return pool;
+                }
+            }
+            if(m_pools.size() >= maxpools)
+            {
+                return m_pools.front();
+            }
+            limit = m_jobs;
+            if(m_adaptive)
+            {
+                // without '--per-device', the one pool reads from every root, so it has to suit all of them
+                limit = std::min(m_jobs, (m_perdevice ? suggestJobs(path) : suggestJobs(m_roots)));
+                if(m_tunefn)
+                {
+                    m_tunefn(path, limit);
+                }
+            }
+            m_pools.push_back(Pool{dev, {}, m_pools.size() * m_jobs, limit, 0, path});
+            auto& pool = m_pools.back();
+            // the first pool is started by walk() itself
+            if(m_pools.size() > 1)
+            {
+                for(i=0; i<m_jobs; i++)
+                {
+                    m_threads.emplace_back([this, &pool, &fn, i]
+                    {
+                        runWorker(pool, pool.firstworker + i, fn);
+                    });
+                }
+            }
+            return pool;
+        }
+
+        // whether this directory was handed to another pool
+        template<typename BatchFuncT>
+        bool reroute(Pool& pool, const Job& job, dev_t dev, BatchFuncT& fn)
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            auto& other = poolFor(dev, job.path, fn);
+            if(&other == &pool)
+            {
+                return false;
+            }
+            other.queue.push_back(job);
+            m_queued++;
+            m_cond.notify_all();
+            return true;
+        }
+
+        /*
+        * whether the directory behind $fd should be read here. with links being followed,
+        * the same directory can show up under any number of paths - including its own
+        * subdirectories - so the first one wins, and the others are skipped.
+        * with setOneFileSystem(), directories on another device than their root are skipped,
+        * and with setPerDevice(), they're handed to the pool of their device.
+        * all of which only needs an fstat() of the directory itself ($st), never of the files in it.
+        */
+        template<typename BatchFuncT>
+        bool shouldRead(Pool& pool, const Job& job, const struct stat& st, BatchFuncT& fn)
+        {
+            if(m_onefs && (st.st_dev != m_rootdevs[job.root]))
+            {
+                return false;
+            }
+            if(m_perdevice && (st.st_dev != pool.dev) && reroute(pool, job, st.st_dev, fn))
+            {
+                return false;
+            }
+            if(m_follow)
+            {
+                std::lock_guard<std::mutex> guard(m_visitlock);
+                return m_visited.emplace(st.st_dev, st.st_ino).second;
+            }
+            return true;
+        }
+
+        // sorts one entry of $job's directory into $subdirs or $items
+        void addEntry(size_t worker, const Job& job, const char* name, ino_t ino, unsigned char type, Kind kind, std::vector<Job>& subdirs, std::vector<Item>& items)
+        {
+            if((kind == Kind::LinkedDirectory) && (!m_follow))
+            {
+                return;
+            }
+            if(kind != Kind::File)
+            {
+                if((m_maxdepth > 0) && ((job.depth + 1) >= m_maxdepth))
+                {
+                    return;
+                }
+                auto subpath = joinPath(job.path, name);
+                if(m_prunefn && m_prunefn(subpath))
+                {
+                    return;
+                }
+                subdirs.push_back(Job{std::move(subpath), job.depth + 1, job.root});
+            }
+            else
+            {
+                if(m_acceptfn && !m_acceptfn(worker, name))
+                {
+                    return;
+                }
+                items.push_back(Item{name, ino, type});
+            }
+        }
+
+        /*
+        * reads one directory (or takes its entries from m_cache); subdirectories are collected
+        * into $subdirs. returns how long the reading itself took (not counting fn), in nanoseconds,
+        * or 0 if the directory wasn't read.
+        */
+        template<typename BatchFuncT>
+        double readDirectory(Pool& pool, size_t worker, const Job& job, std::vector<Job>& subdirs, std::vector<Item>& items, BatchFuncT& fn)
+        {
+            int fd;
+            bool havestat;
+            Kind kind;
+            DIR* dh;
+            double took;
+            struct stat st;
+            struct dirent* ent;
+            const DirCache::Listing* cached;
+            std::vector<DirCache::Record> records;
+            auto started = std::chrono::steady_clock::now();
+            fd = open(job.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if(fd == -1)
+            {
+                if(m_errorfn)
+                {
+                    m_errorfn(m_roots[job.root], job.path, errno);
+                }
+                return 0;
+            }
+            havestat = false;
+            if(m_follow || m_onefs || m_perdevice || (m_cache != nullptr))
+            {
+                havestat = (fstat(fd, &st) == 0);
+                if(havestat && !shouldRead(pool, job, st, fn))
+                {
+                    close(fd);
+                    return 0;
+                }
+            }
+            items.clear();
+            cached = ((havestat && (m_cache != nullptr)) ? m_cache->lookup(st) : nullptr);
+            if(cached != nullptr)
+            {
+                if(m_dirfn)
+                {
+                    m_dirfn(job.path);
+                }
+                for(const auto& rec: cached->records)
+                {
+                    // where a symlink points to can change without its directory noticing
+                    kind = ((rec.type == DT_LNK) ? kindOf(fd, rec.name.c_str(), rec.type) : Kind(rec.kind));
+                    addEntry(worker, job, rec.name.c_str(), rec.ino, rec.type, kind, subdirs, items);
+                }
+                took = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+                if(!items.empty())
+                {
+                    Batch batch{worker, fd, job.path, job.depth, items};
+                    fn(batch);
+                }
+                close(fd);
+                // a cache hit says nothing about the storage, so it's kept out of tune()
+                return 0;
+            }
+            dh = fdopendir(fd);
+            if(dh == nullptr)
+            {
+                if(m_errorfn)
+                {
+                    m_errorfn(m_roots[job.root], job.path, errno);
+                }
+                close(fd);
+                return 0;
+            }
+            if(m_dirfn)
+            {
+                m_dirfn(job.path);
+            }
+            while((ent = readdir(dh)) != nullptr)
+            {
+                if((std::strcmp(ent->d_name, ".") == 0) || (std::strcmp(ent->d_name, "..") == 0))
+                {
+                    continue;
+                }
+                kind = kindOf(fd, ent->d_name, ent->d_type);
+                if(havestat && (m_cache != nullptr))
+                {
+                    records.push_back(DirCache::Record{ent->d_name, uint64_t(ent->d_ino), ent->d_type, (unsigned char)(kind)});
+                }
+                addEntry(worker, job, ent->d_name, ent->d_ino, ent->d_type, kind, subdirs, items);
+            }
+            took = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+            if(havestat && (m_cache != nullptr))
+            {
+                m_cache->store(st, std::move(records));
+            }
+            if(!items.empty())
+            {
+                Batch batch{worker, fd, job.path, job.depth, items};
+                fn(batch);
+            }
+            // also closes fd
+            closedir(dh);
+            return took;
+        }
+
+        /*
+        * a simple feedback loop over windows of 64 directories: as long as the average time
+        * to read one stays close to the best seen so far, another worker is let in. once it
+        * climbs well above that, the storage is queueing requests, and one is taken out again.
+        * the baseline creeps up a little every window, so a change of workload (e.g. from
+        * tiny to huge directories) doesn't leave it stuck. m_lock must be held.
+        */
+        void tune(Pool& pool, double took)
+        {
+            double avg;
+            size_t prevlimit;
+            pool.windowsum += took;
+            pool.windowsize++;
+            if(pool.windowsize < 64)
+            {
+                return;
+            }
+            avg = (pool.windowsum / double(pool.windowsize));
+            pool.windowsum = 0;
+            pool.windowsize = 0;
+            if((pool.baseline == 0) || (avg < pool.baseline))
+            {
+                pool.baseline = avg;
+                return;
+            }
+            prevlimit = pool.limit;
+            if((avg > (pool.baseline * 2.0)) && (pool.limit > 1))
+            {
+                pool.limit--;
+            }
+            else if((avg < (pool.baseline * 1.25)) && (pool.limit < m_jobs) && (pool.queue.size() > pool.limit))
+            {
+                pool.limit++;
+            }
+            pool.baseline *= 1.05;
+            if((pool.limit != prevlimit) && m_tunefn)
+            {
+                m_tunefn(pool.path, pool.limit);
+            }
+        }
+
+        /*
+        * hands every queued directory to m_checkfn. called by the last worker to finish its
+        * directory once m_pausing is set, so nothing is being read, or counted, meanwhile.
+        * m_lock must be held.
+        */
+        void checkpoint()
+        {
+            std::vector<Job> jobs;
+            // with nothing queued, the walk is over anyway
+            if(m_queued > 0)
+            {
+                for(const auto& pool: m_pools)
+                {
+                    jobs.insert(jobs.end(), pool.queue.begin(), pool.queue.end());
+                }
+                m_checkfn(jobs);
+            }
+            m_pausing = false;
+            m_nextcheck = (std::chrono::steady_clock::now() + m_checkevery);
+        }
+
+        template<typename BatchFuncT>
+        void runWorker(Pool& pool, size_t worker, BatchFuncT& fn)
+        {
+            double took;
+            Job job;
+            std::vector<Job> subdirs;
+            std::vector<Item> items;
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> guard(m_lock);
+                    m_cond.wait(guard, [&]
+                    {
+                        return (((!pool.queue.empty()) && (pool.active < pool.limit) && (!m_pausing) && (m_pauses == 0)) || ((m_busy == 0) && (m_queued == 0)));
+                    });
+                    if(pool.queue.empty())
+                    {
+                        return;
+                    }
+                    // LIFO keeps the queue (and memory) small, since it goes depth-first
+                    job = std::move(pool.queue.back());
+                    pool.queue.pop_back();
+                    m_queued--;
+                    m_busy++;
+                    pool.active++;
+                }
+                subdirs.clear();
+                took = readDirectory(pool, worker, job, subdirs, items, fn);
+                {
+                    std::lock_guard<std::mutex> guard(m_lock);
+                    // subdirectories are on the same device, save for mount points - which
+                    // readDirectory() passes on once it finds out
+                    for(auto& sub: subdirs)
+                    {
+                        pool.queue.push_back(std::move(sub));
+                    }
+                    m_queued += subdirs.size();
+                    m_busy--;
+                    pool.active--;
+                    if(m_adaptive && (took > 0))
+                    {
+                        tune(pool, took);
+                    }
+                    if(m_checkfn && (!m_pausing) && (std::chrono::steady_clock::now() >= m_nextcheck))
+                    {
+                        m_pausing = true;
+                    }
+                    if(m_pausing && (m_busy == 0))
+                    {
+                        checkpoint();
+                    }
+                }
+                m_cond.notify_all();
+            }
+        }
+
+    public:
+        /*
+        * a starting point for how many workers suit the storage $path is on:
+        *   in-memory filesystems: as many as there are cpus
+        *   network filesystems: plenty, since most of the time goes to waiting on round trips
+        *   rotational disks: 2, as seeking back and forth costs more than it gains
+        *   everything else (ssd, nvme, ...): as many as there are cpus, but at least 4
+        */
+        static size_t suggestJobs(const std::string& path)
+        {
+            size_t cpus;
+            cpus = std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+            #if defined(COE_ISLINUX)
+                int rot;
+                struct stat st;
+                struct statfs fs;
+                std::string sysdir;
+                if(statfs(path.c_str(), &fs) == 0)
+                {
+                    switch(uint32_t(fs.f_type))
+                    {
+                        // tmpfs, ramfs, proc, sysfs
+                        case 0x01021994:
+                        case 0x858458f6:
+                        case 0x00009fa0:
+                        case 0x62656572:
+                            return cpus;
+                        // nfs, cifs, smb2, fuse, ceph
+                        case 0x00006969:
+                        case 0xff534d42:
+                        case 0xfe534d42:
+                        case 0x65735546:
+                        case 0x00c36400:
+                            return 16;
+                        default:
+                            break;
+                    }
+                }
+                if(stat(path.c_str(), &st) == 0)
+                {
+                    // for partitions, the queue belongs to the parent device
+                    sysdir = ("/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev)));
+                    for(const char* sub: {"/queue/rotational", "/../queue/rotational"})
+                    {
+                        std::ifstream fh(sysdir + sub);
+                        if(fh >> rot)
+                        {
+                            return ((rot == 1) ? 2 : std::max(size_t(4), cpus));
+                        }
+                    }
+                }
+            #else
+                (void)path;
+            #endif
+            return std::max(size_t(4), cpus);
+        }
+
+        // the most conservative suggestJobs() of all $paths
+        static size_t suggestJobs(const std::vector<std::string>& paths)
+        {
+            size_t res;
+            res = size_t(-1);
+            for(const auto& path: paths)
+            {
+                res = std::min(res, suggestJobs(path));
+            }
+            return ((res == size_t(-1)) ? 1 : res);
+        }
+
+    public:
+        DirWalker()
+        {
+        }
+
+        // per pool, i.e., per device with setPerDevice()
+        void setJobs(size_t jobs)
+        {
+            m_jobs = ((jobs == 0) ? 1 : jobs);
+        }
+
+        size_t jobs() const
+        {
+            return m_jobs;
+        }
+
+        // upper bound for Batch::worker
+        size_t maxWorkers() const
+        {
+            return (m_jobs * (m_perdevice ? maxpools : 1));
+        }
+
+        // same meaning as Finder::setMaxDepth(): 0 is unlimited
+        void setMaxDepth(size_t depth)
+        {
+            m_maxdepth = depth;
+        }
+
+        // whether to descend into symlinked directories. every directory is still only read once.
+        void setFollow(bool follow)
+        {
+            m_follow = follow;
+        }
+
+        // whether to stay on the device the walk root is on, i.e., not cross into other mounts
+        void setOneFileSystem(bool onefs)
+        {
+            m_onefs = onefs;
+        }
+
+        // whether every device gets its own pool of workers
+        void setPerDevice(bool perdevice)
+        {
+            m_perdevice = perdevice;
+        }
+
+        // whether to pick, and keep adjusting, the amount of workers per pool; see tune()
+        void setAdaptive(bool adaptive)
+        {
+            m_adaptive = adaptive;
+        }
+
+        // the DirCache to take unchanged directories from, and to record read ones in
+        void setCache(DirCache* cache)
+        {
+            m_cache = cache;
+        }
+
+        void onTune(TuneFunc fn)
+        {
+            m_tunefn = fn;
+        }
+
+        void pruneIf(PruneFunc fn)
+        {
+            m_prunefn = fn;
+        }
+
+        // files only make it into a Batch if fn says so. it gets the bare name, before anything is copied
+        void acceptIf(AcceptFunc fn)
+        {
+            m_acceptfn = fn;
+        }
+
+        // called for every directory, before its entries are read
+        void onDirectory(DirFunc fn)
+        {
+            m_dirfn = fn;
+        }
+
+        void onError(ErrorFunc fn)
+        {
+            m_errorfn = fn;
+        }
+
+        /*
+        * every $seconds, fn is called (from one of the workers) with all directories that are
+        * yet to be read. until it returns, no worker reads anything, and none is in the middle
+        * of reading - so every directory that's not in the list has been handed to BatchFuncT in full.
+        */
+        void onCheckpoint(double seconds, CheckpointFunc fn)
+        {
+            m_checkfn = fn;
+            m_checkevery = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        }
+
+        /*
+        * runs fn() once no worker is in the middle of a directory, while holding all of them
+        * back - so whatever fn looks at holds every directory that's been read, and nothing of
+        * those that haven't. for use from another thread while walk() runs (or before or after it).
+        * every worker waits for fn, so it should only copy what it needs, and leave the rest for later.
+        */
+        template<typename FuncT>
+        void whilePaused(FuncT&& fn)
+        {
+            {
+                std::unique_lock<std::mutex> guard(m_lock);
+                m_pauses++;
+                m_cond.wait(guard, [&]
+                {
+                    return (m_busy == 0);
+                });
+                fn();
+                m_pauses--;
+            }
+            m_cond.notify_all();
+        }
+
+        // with setFollow(), the directories read so far. only safe to look at from within CheckpointFunc
+        const std::set<std::pair<dev_t, ino_t>>& visited() const
+        {
+            return m_visited;
+        }
+
+        // marks a directory as read already, for resume()
+        void addVisited(dev_t dev, ino_t ino)
+        {
+            m_visited.emplace(dev, ino);
+        }
+
+        /*
+        * walks all of $roots, calling fn(Batch&) once per directory that contains anything but
+        * subdirectories. fn is called from several threads at once (but only ever with
+        * its own batch.worker), so it has to keep per-worker state apart.
+        */
+        template<typename BatchFuncT>
+        void walk(const std::vector<std::string>& roots, BatchFuncT& fn)
+        {
+            size_t i;
+            std::vector<Job> jobs;
+            // queues are taken from the back, so this has the roots walked in the order they were given
+            for(i=roots.size(); i-- > 0;)
+            {
+                jobs.push_back(Job{roots[i], 0, i});
+            }
+            resume(roots, jobs, fn);
+        }
+
+        /*
+        * continues a walk of $roots that was interrupted with $jobs still queued (as handed
+        * to CheckpointFunc), i.e., only reads those, and whatever is below them.
+        */
+        template<typename BatchFuncT>
+        void resume(const std::vector<std::string>& roots, const std::vector<Job>& jobs, BatchFuncT& fn)
+        {
+            size_t i;
+            dev_t dev;
+            struct stat st;
+            std::vector<std::thread> threads;
+            m_roots = roots;
+            m_rootdevs.clear();
+            for(const auto& root: m_roots)
+            {
+                m_rootdevs.push_back((stat(root.c_str(), &st) == 0) ? st.st_dev : 0);
+            }
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_busy = 0;
+                m_queued = 0;
+                m_pausing = false;
+                m_nextcheck = (std::chrono::steady_clock::now() + m_checkevery);
+                for(const auto& job: jobs)
+                {
+                    dev = 0;
+                    if(m_perdevice)
+                    {
+                        dev = ((job.depth == 0) ? m_rootdevs[job.root] : ((stat(job.path.c_str(), &st) == 0) ? st.st_dev : 0));
+                    }
+                    auto& pool = poolFor(dev, job.path, fn);
+                    pool.queue.push_back(job);
+                    m_queued++;
+                }
+            }
+            if(m_pools.empty())
+            {
+                return;
+            }
+            auto& first = m_pools.front();
+            for(i=1; i<m_jobs; i++)
+            {
+                threads.emplace_back([&, i]
+                {
+                    runWorker(first, i, fn);
+                });
+            }
+            runWorker(first, 0, fn);
+            for(auto& th: threads)
+            {
+                th.join();
+            }
+            // nothing can start new pools anymore, once all work is done
+            for(auto& th: m_threads)
+            {
+                th.join();
+            }
+            m_threads.clear();
+            m_pools.clear();
+        }
+
+        template<typename BatchFuncT>
+        void walk(const std::string& root, BatchFuncT& fn)
+        {
+            walk(std::vector<std::string>{root}, fn);
+        }
+};
+
+#endif /* COE_ISUNIXLIKE */
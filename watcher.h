@@ -0,0 +1,356 @@
+
+/*
+* keeps an eye on directory trees through inotify, for '--watch'.
+* directories are added one by one (usually by whatever walks them first), and run() then
+* turns what inotify reports into files added and removed, directories added, and the
+* occasional "lost track": a directory moved out of the watched trees takes its files
+* along without a word about them, and a full event queue drops events altogether - both
+* of which only a fresh walk can fix.
+*
+* run() also handles the signals that drive '--watch': SIGUSR1 asks for the current counts,
+* and SIGINT/SIGTERM end it. they're taken through a signalfd, so they have to be blocked in
+* every thread. SIGUSR1 is blocked as soon as the watcher is opened - which has to happen
+* before any walker threads are started, since those inherit the signal mask. SIGINT and
+* SIGTERM are only blocked once run() starts, so they still end the initial walk as usual;
+* the walker threads of that are gone by then, and any started later inherit the new mask.
+*
+* symlinks to directories aren't counted by the walk, so they're skipped here when they
+* appear. once they're removed, though, there's no telling what they pointed to.
+*/
+
+#pragma once
+
+#include "glue.h"
+
+#if defined(COE_ISLINUX)
+
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+class DirWatcher
+{
+    public:
+        enum class Event
+        {
+            FileAdded,
+            FileRemoved,
+            // a new directory (or one moved in); it still has to be walked, and its subdirectories added
+            DirectoryAdded,
+            // events went missing; run() returns right after, and the counts need to be started over, after reset()
+            Lost,
+            // time (or SIGUSR1) to print the counts
+            Emit,
+        };
+
+        using EventFunc = std::function<void(Event, const std::string&)>;
+
+    private:
+        static constexpr uint32_t watchmask = (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+
+        struct MovedDir
+        {
+            uint32_t cookie;
+            std::string path;
+        };
+
+    private:
+        int m_fd = -1;
+        int m_sigfd = -1;
+        // add() is called by walker threads
+        std::mutex m_lock;
+        std::unordered_map<int, std::string> m_paths;
+        size_t m_failed = 0;
+        // a directory moved away, until it's clear whether it was moved within the watched trees
+        bool m_havemoved = false;
+        MovedDir m_moved;
+        // Event::Lost was reported; run() returns once it has
+        bool m_lost = false;
+
+    private:
+        static std::string joinPath(const std::string& dir, const char* name)
+        {
+            std::string res;
+            res = dir;
+            if(res.empty() || (res.back() != '/'))
+            {
+                res.push_back('/');
+            }
+            res.append(name);
+            return res;
+        }
+
+        // a directory within the watched trees was renamed: everything below it moves along
+        void renamed(const std::string& from, const std::string& to)
+        {
+            for(auto& it: m_paths)
+            {
+                auto& path = it.second;
+                if((path.compare(0, from.size(), from) == 0) && ((path.size() == from.size()) || (path[from.size()] == '/')))
+                {
+                    path = (to + path.substr(from.size()));
+                }
+            }
+        }
+
+        void reportLost(const EventFunc& fn, const std::string& path)
+        {
+            m_havemoved = false;
+            m_lost = true;
+            fn(Event::Lost, path);
+        }
+
+        // a directory moved away that didn't show up again. returns true if that was the case
+        bool settleMoved(const EventFunc& fn)
+        {
+            if(m_havemoved)
+            {
+                reportLost(fn, m_moved.path);
+                return true;
+            }
+            return false;
+        }
+
+        /*
+        * returns false once the events can no longer be trusted (and Event::Lost was reported) -
+        * the rest of them are then stale, since the counts are started over anyway.
+        */
+        bool handleEvent(const struct inotify_event* ev, const EventFunc& fn)
+        {
+            bool isdir;
+            struct stat st;
+            std::string path;
+            if(ev->mask & IN_Q_OVERFLOW)
+            {
+                reportLost(fn, "");
+                return false;
+            }
+            if(m_havemoved && (!(ev->mask & IN_MOVED_TO) || (ev->cookie != m_moved.cookie)))
+            {
+                settleMoved(fn);
+                return false;
+            }
+            if(ev->mask & IN_IGNORED)
+            {
+                m_paths.erase(ev->wd);
+                return true;
+            }
+            auto it = m_paths.find(ev->wd);
+            if((it == m_paths.end()) || (ev->len == 0))
+            {
+                return true;
+            }
+            path = joinPath(it->second, ev->name);
+            isdir = (ev->mask & IN_ISDIR);
+            if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+            {
+                if(isdir)
+                {
+                    if(m_havemoved)
+                    {
+                        m_havemoved = false;
+                        renamed(m_moved.path, path);
+                        return true;
+                    }
+                    fn(Event::DirectoryAdded, path);
+                }
+                else if((stat(path.c_str(), &st) != 0) || !S_ISDIR(st.st_mode))
+                {
+                    fn(Event::FileAdded, path);
+                }
+            }
+            else if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                if(!isdir)
+                {
+                    fn(Event::FileRemoved, path);
+                }
+                else if(ev->mask & IN_MOVED_FROM)
+                {
+                    m_havemoved = true;
+                    m_moved = MovedDir{ev->cookie, path};
+                }
+                // a removed directory was empty, so its files have been reported already
+            }
+            return true;
+        }
+
+    public:
+        DirWatcher()
+        {
+        }
+
+        ~DirWatcher()
+        {
+            if(m_fd != -1)
+            {
+                close(m_fd);
+            }
+            if(m_sigfd != -1)
+            {
+                close(m_sigfd);
+            }
+        }
+
+        bool open()
+        {
+            sigset_t sigs;
+            m_fd = inotify_init1(IN_CLOEXEC);
+            if(m_fd == -1)
+            {
+                return false;
+            }
+            sigemptyset(&sigs);
+            sigaddset(&sigs, SIGUSR1);
+            if(pthread_sigmask(SIG_BLOCK, &sigs, nullptr) != 0)
+            {
+                return false;
+            }
+            sigaddset(&sigs, SIGINT);
+            sigaddset(&sigs, SIGTERM);
+            m_sigfd = signalfd(-1, &sigs, SFD_CLOEXEC);
+            return (m_sigfd != -1);
+        }
+
+        /*
+        * drops every watch (and whatever events are still queued), by starting over with a new
+        * inotify instance. for after Event::Lost, where the directories are walked (and added) again.
+        */
+        bool reset()
+        {
+            close(m_fd);
+            m_paths.clear();
+            m_havemoved = false;
+            m_failed = 0;
+            m_fd = inotify_init1(IN_CLOEXEC);
+            return (m_fd != -1);
+        }
+
+        // returns false if $path can't be watched; most likely, fs.inotify.max_user_watches was hit
+        bool add(const std::string& path)
+        {
+            int wd;
+            wd = inotify_add_watch(m_fd, path.c_str(), watchmask);
+            std::lock_guard<std::mutex> guard(m_lock);
+            if(wd == -1)
+            {
+                m_failed++;
+                return false;
+            }
+            m_paths[wd] = path;
+            return true;
+        }
+
+        size_t size() const
+        {
+            return m_paths.size();
+        }
+
+        // how many directories couldn't be watched
+        size_t failed() const
+        {
+            return m_failed;
+        }
+
+        /*
+        * reports events to $fn, and Event::Emit every $interval seconds (if not 0), until SIGINT or SIGTERM.
+        * must be called from the thread that called open(), with no other threads running.
+        * returns true if it stopped because of Event::Lost - to be called again once the counts
+        * have been started over - and false if it was told to stop.
+        */
+        bool run(double interval, const EventFunc& fn)
+        {
+            int timeout;
+            ssize_t got;
+            sigset_t sigs;
+            struct pollfd fds[2];
+            struct signalfd_siginfo sig;
+            sigemptyset(&sigs);
+            sigaddset(&sigs, SIGINT);
+            sigaddset(&sigs, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+            alignas(struct inotify_event) char buf[64 * 1024];
+            auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+            auto next = (std::chrono::steady_clock::now() + step);
+            m_lost = false;
+            while(true)
+            {
+                // m_fd changes with reset()
+                fds[0] = {m_fd, POLLIN, 0};
+                fds[1] = {m_sigfd, POLLIN, 0};
+                timeout = -1;
+                if(interval > 0)
+                {
+                    timeout = int(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count()));
+                }
+                // a directory moved away pairs up with its arrival right away, if there is one
+                if(m_havemoved)
+                {
+                    timeout = ((timeout == -1) ? 100 : std::min(timeout, 100));
+                }
+                if(poll(fds, 2, timeout) == -1)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                if(!(fds[0].revents & POLLIN) && !(fds[1].revents & POLLIN))
+                {
+                    if(settleMoved(fn))
+                    {
+                        return true;
+                    }
+                }
+                if(fds[1].revents & POLLIN)
+                {
+                    if(read(m_sigfd, &sig, sizeof(sig)) == ssize_t(sizeof(sig)))
+                    {
+                        if(sig.ssi_signo != SIGUSR1)
+                        {
+                            settleMoved(fn);
+                            return false;
+                        }
+                        fn(Event::Emit, "");
+                    }
+                }
+                if(fds[0].revents & POLLIN)
+                {
+                    got = read(m_fd, buf, sizeof(buf));
+                    for(ssize_t pos=0; pos<got;)
+                    {
+                        auto ev = reinterpret_cast<const struct inotify_event*>(buf + pos);
+                        if(!handleEvent(ev, fn))
+                        {
+                            break;
+                        }
+                        pos += (sizeof(struct inotify_event) + ev->len);
+                    }
+                    if(m_lost)
+                    {
+                        return true;
+                    }
+                }
+                if((interval > 0) && (std::chrono::steady_clock::now() >= next))
+                {
+                    fn(Event::Emit, "");
+                    next = (std::chrono::steady_clock::now() + step);
+                }
+            }
+        }
+};
+
+#endif